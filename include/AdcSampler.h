@@ -0,0 +1,73 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <soc/soc_caps.h>
+#include "AnalogFilter.h"
+
+// ADC continuous (DMA) mode through the IDF 4.4 adc_digi driver
+#if defined(SOC_ADC_DMA_SUPPORTED) || defined(SOC_ADC_SUPPORT_DMA_MODE)
+#define ADC_SAMPLER_DMA 1
+#include <driver/adc.h>
+#else
+#define ADC_SAMPLER_DMA 0
+#endif
+
+// Continuous analog sampling of ADC1 pins.
+//
+// The ADC digital controller converts every attached ADC1 channel round-robin
+// and streams the results into a DMA buffer. A small task drains the buffer
+// and runs each conversion through the pin's AnalogFilter, so reports only
+// read the latest filtered value and never wait for a conversion.
+//
+// The driver owns ADC1 while it runs, so analogRead() must not be used on
+// ADC1 pins at the same time. Pins that cannot be sampled (ADC2, or no DMA
+// support) are refused by attach() and left to analogRead().
+class AdcSampler {
+public:
+    static const uint32_t SAMPLE_RATE_HZ = 20000;   // Shared by all channels (ESP32 minimum)
+    static const uint32_t READ_TIMEOUT_MS = 100;
+    
+    AdcSampler();
+    ~AdcSampler();
+    
+    // Start sampling pin with the given filter. Returns false if the pin is
+    // not an ADC1 channel or continuous mode is unavailable.
+    bool attach(uint8_t pin, const AnalogFilterConfig& filter);
+    void detach(uint8_t pin);
+    
+    // True while the sampler is responsible for this pin
+    bool owns(uint8_t pin);
+    
+    // Latest filtered value; false until the first filter output
+    bool read(uint8_t pin, uint16_t& value);
+
+private:
+    static const uint8_t MAX_CHANNELS = SOC_ADC_MAX_CHANNEL_NUM;
+    static const uint32_t FRAME_BYTES = 256;
+    
+    struct Channel {
+        bool active;
+        uint8_t pin;
+        AnalogFilter filter;
+    };
+    
+    Channel channels[MAX_CHANNELS];     // Indexed by ADC1 channel
+    uint32_t requestedMask;             // Channels wanted by attach/detach
+    uint32_t runningMask;               // Channels the driver runs (sampler task)
+    bool driverFailed;
+    TaskHandle_t taskHandle;
+    portMUX_TYPE lock;
+    uint8_t frame[FRAME_BYTES];
+    
+    int channelForPin(uint8_t pin);
+    static void taskFunction(void* parameter);
+    void run();
+    bool startDriver(uint32_t mask);
+    void stopDriver();
+    void consume(const uint8_t* data, uint32_t length);
+};
+
+#endif // ADC_SAMPLER_H
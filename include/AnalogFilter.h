@@ -0,0 +1,155 @@
+#ifndef ANALOG_FILTER_H
+#define ANALOG_FILTER_H
+
+#include <cstdint>
+
+// Per-pin analog filter settings
+struct AnalogFilterConfig {
+    uint8_t oversample;     // Raw conversions averaged into one sample (1..64)
+    uint8_t median;         // Median window in samples, odd (1 = off, up to 7)
+    uint8_t average;        // Moving-average window in samples (1 = off, up to 16)
+    uint8_t iirShift;       // IIR smoothing y += (x - y) / 2^shift (0 = off, up to 8)
+};
+
+// Fixed-point filter chain for a stream of ADC conversions.
+//
+// Raw conversions are decimated by oversampling, then pass through an
+// optional median (spike rejection), moving average and first-order IIR, in
+// that order. Everything is integer arithmetic on bounded buffers.
+class AnalogFilter {
+public:
+    static const uint8_t MAX_OVERSAMPLE = 64;
+    static const uint8_t MAX_MEDIAN = 7;
+    static const uint8_t MAX_AVERAGE = 16;
+    static const uint8_t MAX_IIR_SHIFT = 8;
+    
+    static AnalogFilterConfig defaults() {
+        return {16, 1, 1, 0};
+    }
+    
+    static bool isValid(const AnalogFilterConfig& config) {
+        return config.oversample >= 1 && config.oversample <= MAX_OVERSAMPLE &&
+               config.median >= 1 && config.median <= MAX_MEDIAN && (config.median & 0x1) &&
+               config.average >= 1 && config.average <= MAX_AVERAGE &&
+               config.iirShift <= MAX_IIR_SHIFT;
+    }
+    
+    AnalogFilter() {
+        config = defaults();
+        reset();
+    }
+    
+    bool configure(const AnalogFilterConfig& newConfig) {
+        if (!isValid(newConfig)) {
+            return false;
+        }
+        config = newConfig;
+        reset();
+        return true;
+    }
+    
+    void reset() {
+        oversampleSum = 0;
+        oversampleCount = 0;
+        medianCount = 0;
+        medianHead = 0;
+        averageSum = 0;
+        averageCount = 0;
+        averageHead = 0;
+        iirState = 0;
+        output = 0;
+        hasOutput = false;
+    }
+    
+    // Feed one raw conversion. Returns true when it completed an
+    // oversampling group and value() was updated.
+    bool push(uint16_t raw) {
+        oversampleSum += raw;
+        if (++oversampleCount < config.oversample) {
+            return false;
+        }
+        
+        uint32_t x = (oversampleSum + config.oversample / 2) / config.oversample;
+        oversampleSum = 0;
+        oversampleCount = 0;
+        
+        if (config.median > 1) {
+            medianWindow[medianHead] = (uint16_t)x;
+            medianHead = (medianHead + 1) % config.median;
+            if (medianCount < config.median) {
+                medianCount++;
+            }
+            x = median();
+        }
+        
+        if (config.average > 1) {
+            if (averageCount == config.average) {
+                averageSum -= averageWindow[averageHead];
+            } else {
+                averageCount++;
+            }
+            averageWindow[averageHead] = (uint16_t)x;
+            averageSum += x;
+            averageHead = (averageHead + 1) % config.average;
+            x = (averageSum + averageCount / 2) / averageCount;
+        }
+        
+        if (config.iirShift > 0) {
+            // State carries IIR_FRACTION_BITS of fraction so small steps are
+            // not lost to truncation; the first sample primes it
+            int32_t target = (int32_t)(x << IIR_FRACTION_BITS);
+            if (!hasOutput) {
+                iirState = target;
+            } else {
+                iirState += (target - iirState) >> config.iirShift;
+            }
+            x = (uint32_t)((iirState + (1 << (IIR_FRACTION_BITS - 1))) >> IIR_FRACTION_BITS);
+        }
+        
+        output = (uint16_t)x;
+        hasOutput = true;
+        return true;
+    }
+    
+    bool ready() const { return hasOutput; }
+    uint16_t value() const { return output; }
+    const AnalogFilterConfig& getConfig() const { return config; }
+
+private:
+    static const uint8_t IIR_FRACTION_BITS = 8;
+    
+    AnalogFilterConfig config;
+    
+    uint32_t oversampleSum;
+    uint8_t oversampleCount;
+    
+    uint16_t medianWindow[MAX_MEDIAN];
+    uint8_t medianCount;
+    uint8_t medianHead;
+    
+    uint16_t averageWindow[MAX_AVERAGE];
+    uint32_t averageSum;
+    uint8_t averageCount;
+    uint8_t averageHead;
+    
+    int32_t iirState;
+    uint16_t output;
+    bool hasOutput;
+    
+    uint16_t median() const {
+        // Insertion sort of at most MAX_MEDIAN values
+        uint16_t sorted[MAX_MEDIAN];
+        for (uint8_t i = 0; i < medianCount; i++) {
+            uint16_t v = medianWindow[i];
+            uint8_t j = i;
+            while (j > 0 && sorted[j - 1] > v) {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = v;
+        }
+        return sorted[medianCount / 2];
+    }
+};
+
+#endif // ANALOG_FILTER_H
@@ -0,0 +1,81 @@
+#ifndef BOARD_PROFILE_H
+#define BOARD_PROFILE_H
+
+#include <stdint.h>
+#include <sdkconfig.h>
+
+// Compile-time GPIO capabilities of the target chip.
+//
+// Every capability is a 64-bit mask (bit n = GPIO n), so checking a pin is a
+// single AND. The profile is picked from the IDF target the firmware is built
+// for; module-specific pins (e.g. PSRAM on WROVER) are left to the exclude
+// list.
+struct BoardProfile {
+    const char* name;
+    uint64_t gpio;          // Pins that exist on the chip
+    uint64_t flash;         // Wired to SPI flash, never usable
+    uint64_t strapping;     // Sampled at reset; usable, but can affect boot
+    uint64_t inputOnly;     // No output driver and no internal pull-ups
+    uint64_t adc1;
+    uint64_t adc2;          // Shared with WiFi, analogRead only while idle
+    uint64_t touch;
+};
+
+// Mask of GPIOs from..to inclusive
+constexpr uint64_t gpioRange(uint8_t from, uint8_t to) {
+    return (~0ULL >> (63 - to)) & (~0ULL << from);
+}
+
+#define GPIO_BIT(n) (1ULL << (n))
+
+#if CONFIG_IDF_TARGET_ESP32S2
+static constexpr BoardProfile BOARD_PROFILE = {
+    "esp32s2",
+    gpioRange(0, 21) | gpioRange(26, 46),
+    gpioRange(26, 32),
+    GPIO_BIT(0) | GPIO_BIT(45) | GPIO_BIT(46),
+    GPIO_BIT(46),
+    gpioRange(1, 10),
+    gpioRange(11, 20),
+    gpioRange(1, 14)
+};
+#elif CONFIG_IDF_TARGET_ESP32S3
+static constexpr BoardProfile BOARD_PROFILE = {
+    "esp32s3",
+    gpioRange(0, 21) | gpioRange(26, 48),
+    gpioRange(26, 32),
+    GPIO_BIT(0) | GPIO_BIT(3) | GPIO_BIT(45) | GPIO_BIT(46),
+    0,
+    gpioRange(1, 10),
+    gpioRange(11, 20),
+    gpioRange(1, 14)
+};
+#elif CONFIG_IDF_TARGET_ESP32C3
+static constexpr BoardProfile BOARD_PROFILE = {
+    "esp32c3",
+    gpioRange(0, 21),
+    gpioRange(12, 17),
+    GPIO_BIT(2) | GPIO_BIT(8) | GPIO_BIT(9),
+    0,
+    gpioRange(0, 4),
+    GPIO_BIT(5),
+    0
+};
+#else
+static constexpr BoardProfile BOARD_PROFILE = {
+    "esp32",
+    gpioRange(0, 19) | gpioRange(21, 23) | gpioRange(25, 27) | gpioRange(32, 39),
+    gpioRange(6, 11),
+    GPIO_BIT(0) | GPIO_BIT(2) | GPIO_BIT(5) | GPIO_BIT(12) | GPIO_BIT(15),
+    gpioRange(34, 39),
+    gpioRange(32, 39),
+    GPIO_BIT(0) | GPIO_BIT(2) | GPIO_BIT(4) | gpioRange(12, 15) | gpioRange(25, 27),
+    GPIO_BIT(0) | GPIO_BIT(2) | GPIO_BIT(4) | gpioRange(12, 15) | GPIO_BIT(27) |
+        GPIO_BIT(32) | GPIO_BIT(33)
+};
+#endif
+
+static_assert((BOARD_PROFILE.flash & ~BOARD_PROFILE.gpio) == 0, "Flash pins outside the GPIO set");
+static_assert(((BOARD_PROFILE.adc1 | BOARD_PROFILE.adc2) & BOARD_PROFILE.flash) == 0, "ADC pin marked as flash");
+
+#endif // BOARD_PROFILE_H
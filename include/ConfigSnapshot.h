@@ -0,0 +1,113 @@
+#ifndef CONFIG_SNAPSHOT_H
+#define CONFIG_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+
+// Double-buffered configuration with wait-free readers (Left-Right).
+//
+// Readers always see a complete, immutable copy of T. A reader registers
+// with one of two read indicators, reads whichever copy is active and
+// deregisters; it never loops or blocks. The single writer edits the
+// inactive copy, makes it active with one atomic store, then waits until no
+// reader can still be on the old copy before it is reused. Readers that keep
+// arriving cannot starve the writer: they register with the other indicator,
+// which the writer does not wait for.
+//
+// There must be only one writer at a time, and it must not hold a Reader
+// while it publishes. Keep read sections short and never hold a Reader
+// while waiting for other work, since the writer waits for them.
+//
+// Readers must not nest. A second Reader taken while a publish is under way
+// sees the new copy while the outer one still sees the old, so one operation
+// would mix two configurations. Code that already holds a Reader passes the
+// view (const T&) down instead of opening another.
+//
+// Nothing is allocated; the writer's wait calls 'relax' (e.g. a task delay)
+// between polls.
+template <typename T>
+class ConfigSnapshot {
+public:
+    class Reader {
+    public:
+        explicit Reader(ConfigSnapshot& snapshot)
+            : owner(snapshot),
+              indicator(snapshot.versionIndex.load()) {
+            owner.readers[indicator].fetch_add(1);
+            view = &owner.copies[owner.active.load()];
+        }
+        
+        ~Reader() {
+            owner.readers[indicator].fetch_sub(1, std::memory_order_release);
+        }
+        
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        
+        const T& operator*() const { return *view; }
+        const T* operator->() const { return view; }
+    
+    private:
+        ConfigSnapshot& owner;
+        uint8_t indicator;
+        const T* view;
+    };
+    
+    explicit ConfigSnapshot(void (*relax)() = nullptr)
+        : copies(), active(0), versionIndex(0), published(0), relaxFn(relax) {
+        readers[0].store(0);
+        readers[1].store(0);
+    }
+    
+    // Writer side: the inactive copy, refreshed from the active one. Changes
+    // stay invisible to readers until publish(); dropping them just means not
+    // calling it.
+    T& edit() {
+        uint8_t next = 1 - active.load(std::memory_order_relaxed);
+        copies[next] = copies[active.load(std::memory_order_relaxed)];
+        return copies[next];
+    }
+    
+    // Writer side: make the edited copy current. Returns once no reader can
+    // still see the previous one.
+    void publish() {
+        active.store(1 - active.load(std::memory_order_relaxed));
+        
+        uint8_t previous = versionIndex.load();
+        uint8_t next = 1 - previous;
+        waitForReaders(next);       // Stragglers from the last publish
+        versionIndex.store(next);
+        waitForReaders(previous);
+        
+        published.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Writer side: the current copy, safe to read without a Reader only from
+    // the writer itself
+    const T& current() const {
+        return copies[active.load(std::memory_order_relaxed)];
+    }
+    
+    // Number of publishes so far
+    uint32_t version() const {
+        return published.load(std::memory_order_relaxed);
+    }
+
+private:
+    T copies[2];
+    std::atomic<uint8_t> active;            // Copy new readers are sent to
+    std::atomic<uint8_t> versionIndex;      // Indicator new readers register with
+    std::atomic<uint32_t> readers[2];
+    std::atomic<uint32_t> published;
+    void (*relaxFn)();
+    
+    void waitForReaders(uint8_t indicator) {
+        while (readers[indicator].load() != 0) {
+            if (relaxFn != nullptr) {
+                relaxFn();
+            }
+        }
+    }
+};
+
+#endif // CONFIG_SNAPSHOT_H
@@ -0,0 +1,146 @@
+#ifndef DEADLINE_HEAP_H
+#define DEADLINE_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-capacity indexed min-heap of deadlines.
+//
+// Each of the N ids (e.g. GPIO numbers) has at most one pending deadline.
+// Scheduling, rescheduling and cancelling an id are O(log n) in place, and
+// finding the next due entry is O(1), so the cost of a scheduler tick depends
+// only on how many deadlines are actually due - not on how many ids exist.
+template <size_t N>
+class DeadlineHeap {
+    static_assert(N > 0 && N < 255, "DeadlineHeap ids must fit in uint8_t");
+
+public:
+    static const uint8_t NOT_SCHEDULED = 0xFF;
+
+    DeadlineHeap() : count(0) {
+        for (size_t i = 0; i < N; i++) {
+            position[i] = NOT_SCHEDULED;
+        }
+    }
+
+    // Insert a deadline for id, or move the existing one
+    bool schedule(uint8_t id, int64_t due) {
+        if (id >= N) {
+            return false;
+        }
+
+        uint8_t pos = position[id];
+        if (pos == NOT_SCHEDULED) {
+            pos = (uint8_t)count++;
+            heap[pos] = {due, id};
+            position[id] = pos;
+            siftUp(pos);
+        } else {
+            int64_t previous = heap[pos].due;
+            heap[pos].due = due;
+            if (due < previous) {
+                siftUp(pos);
+            } else {
+                siftDown(pos);
+            }
+        }
+        return true;
+    }
+
+    bool cancel(uint8_t id) {
+        if (id >= N || position[id] == NOT_SCHEDULED) {
+            return false;
+        }
+        removeAt(position[id]);
+        return true;
+    }
+
+    bool isScheduled(uint8_t id) const {
+        return id < N && position[id] != NOT_SCHEDULED;
+    }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    // Earliest deadline, or INT64_MAX when nothing is scheduled
+    int64_t nextDue() const {
+        return count > 0 ? heap[0].due : INT64_MAX;
+    }
+
+    // Remove and return the earliest entry if it is due at 'now'
+    bool popDue(int64_t now, uint8_t& id, int64_t& due) {
+        if (count == 0 || heap[0].due > now) {
+            return false;
+        }
+        id = heap[0].id;
+        due = heap[0].due;
+        removeAt(0);
+        return true;
+    }
+
+private:
+    struct Entry {
+        int64_t due;
+        uint8_t id;
+    };
+
+    Entry heap[N];
+    uint8_t position[N];    // id -> index in heap, or NOT_SCHEDULED
+    size_t count;
+
+    void place(size_t pos, const Entry& entry) {
+        heap[pos] = entry;
+        position[entry.id] = (uint8_t)pos;
+    }
+
+    void siftUp(size_t pos) {
+        Entry entry = heap[pos];
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if (heap[parent].due <= entry.due) {
+                break;
+            }
+            place(pos, heap[parent]);
+            pos = parent;
+        }
+        place(pos, entry);
+    }
+
+    void siftDown(size_t pos) {
+        Entry entry = heap[pos];
+        while (true) {
+            size_t child = pos * 2 + 1;
+            if (child >= count) {
+                break;
+            }
+            if (child + 1 < count && heap[child + 1].due < heap[child].due) {
+                child++;
+            }
+            if (entry.due <= heap[child].due) {
+                break;
+            }
+            place(pos, heap[child]);
+            pos = child;
+        }
+        place(pos, entry);
+    }
+
+    void removeAt(size_t pos) {
+        position[heap[pos].id] = NOT_SCHEDULED;
+        count--;
+        if (pos == count) {
+            return;
+        }
+
+        // Move the last entry into the hole and restore heap order
+        int64_t removedDue = heap[pos].due;
+        place(pos, heap[count]);
+        if (heap[pos].due < removedDue) {
+            siftUp(pos);
+        } else {
+            siftDown(pos);
+        }
+    }
+};
+
+#endif // DEADLINE_HEAP_H
@@ -0,0 +1,58 @@
+#ifndef DEVICE_TOPICS_H
+#define DEVICE_TOPICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Fixed per-device topics
+enum class DeviceTopic : uint8_t {
+    STATUS,
+    CONFIG,
+    SIGNAL_STRENGTH,
+    OTA_STATUS,
+    IO_OUTPUTS,
+    IO_SNAPSHOT,
+    IO_BATCH,
+    IO_HISTORY,
+    IO_CONFIG,
+    COUNT
+};
+
+// The full topic of every DeviceTopic, formatted once under the device's
+// base topic so publishing never concatenates strings.
+class DeviceTopicTable {
+public:
+    static const size_t TOPIC_MAX = 64;
+    
+    DeviceTopicTable() {
+        for (size_t i = 0; i < (size_t)DeviceTopic::COUNT; i++) {
+            topics[i][0] = '\0';
+        }
+    }
+    
+    // False if a topic had to be cut short
+    bool build(const char* baseTopic) {
+        // Indexed by DeviceTopic
+        static const char* const suffixes[] = {
+            "status", "config", "signal/strenght", "ota/status",
+            "io/outputs", "io/snapshot", "io/batch", "io/history", "io/config"
+        };
+        static_assert(sizeof(suffixes) / sizeof(suffixes[0]) == (size_t)DeviceTopic::COUNT,
+                      "Every DeviceTopic needs a suffix");
+        
+        bool complete = true;
+        for (size_t i = 0; i < (size_t)DeviceTopic::COUNT; i++) {
+            int length = snprintf(topics[i], TOPIC_MAX, "%s/%s", baseTopic, suffixes[i]);
+            complete = complete && length > 0 && (size_t)length < TOPIC_MAX;
+        }
+        return complete;
+    }
+    
+    const char* get(DeviceTopic id) const { return topics[(size_t)id]; }
+    
+private:
+    char topics[(size_t)DeviceTopic::COUNT][TOPIC_MAX];
+};
+
+#endif // DEVICE_TOPICS_H
@@ -0,0 +1,64 @@
+#ifndef EVENT_HISTORY_H
+#define EVENT_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-size record of the most recent events, oldest overwritten first.
+//
+// Every entry gets a sequence number that keeps counting across wrap-around,
+// so a reader can walk the history in pieces with a cursor: entries that were
+// overwritten between two reads are skipped and show up as a jump in the
+// oldest sequence. Nothing is allocated after construction.
+//
+// Not thread-safe on its own; callers serialize record() and collect().
+template <typename T, size_t N>
+class EventHistory {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "EventHistory size must be a power of two");
+
+public:
+    EventHistory() : head(0) {}
+    
+    void record(const T& item) {
+        slots[head & (N - 1)] = item;
+        head++;
+    }
+    
+    // Sequence number of the oldest entry still held
+    uint32_t oldest() const { return head > N ? head - N : 0; }
+    
+    // Sequence number the next entry will get
+    uint32_t next() const { return head; }
+    
+    // Copy up to 'max' entries accepted by 'match' from the range
+    // [cursor, end), looking at no more than 'maxScan' entries. Advances
+    // 'cursor' past everything examined; returns the number of entries copied.
+    template <typename Match>
+    size_t collect(uint32_t& cursor, uint32_t end, Match match, T* out, size_t max, size_t maxScan) const {
+        if ((int32_t)(cursor - oldest()) < 0) {
+            cursor = oldest();
+        }
+        if ((int32_t)(end - head) > 0) {
+            end = head;
+        }
+        
+        size_t count = 0;
+        while ((int32_t)(end - cursor) > 0 && count < max && maxScan > 0) {
+            const T& item = slots[cursor & (N - 1)];
+            if (match(item)) {
+                out[count++] = item;
+            }
+            cursor++;
+            maxScan--;
+        }
+        return count;
+    }
+    
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T slots[N];
+    uint32_t head;      // Total entries ever recorded
+};
+
+#endif // EVENT_HISTORY_H
@@ -0,0 +1,137 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Lock-free single-producer/single-consumer ring buffer with drop-oldest
+// overflow semantics.
+//
+// The producer (typically an ISR) never blocks and never fails: when the ring
+// is full it advances the tail itself, discarding the oldest entry, and bumps
+// the overflow counter. Because the producer may move the tail, the consumer
+// claims entries with a compare-and-swap on the tail.
+//
+// A dropped slot can be overwritten while the consumer is still copying it, so
+// every slot is a small seqlock: the payload is stored as atomic words
+// bracketed by a per-slot sequence number (odd while the producer writes,
+// 2 * index + 2 once the entry for that index is complete). The consumer only
+// keeps a copy whose sequence matched before and after reading it; anything
+// else means the entry was dropped and is skipped without a torn value ever
+// leaving the ring.
+//
+// The ring does not allocate. All methods used by the producer are forced
+// inline so no out-of-line copy ends up in flash.
+template <typename T, size_t N>
+class EventRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "EventRing size must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "EventRing entries are copied word by word");
+
+public:
+    EventRing() : head(0), tail(0), dropped(0) {
+        for (size_t i = 0; i < N; i++) {
+            slots[i].seq.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Producer side. Returns false if an older entry had to be discarded.
+    inline __attribute__((always_inline)) bool push(const T& item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+        bool kept = true;
+
+        while (h - t >= N) {
+            // Full: drop the oldest entry. A failed CAS means the consumer
+            // just freed a slot, so re-check before dropping anything.
+            if (tail.compare_exchange_weak(t, t + 1,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                kept = false;
+                break;
+            }
+        }
+
+        Slot& slot = slots[h & (N - 1)];
+        uint32_t words[WORDS] = {};
+        memcpy(words, &item, sizeof(T));
+
+        // Release stores keep the odd sequence ahead of every payload word
+        slot.seq.store(2 * h + 1, std::memory_order_relaxed);
+        for (size_t i = 0; i < WORDS; i++) {
+            slot.words[i].store(words[i], std::memory_order_release);
+        }
+        slot.seq.store(2 * h + 2, std::memory_order_release);
+
+        head.store(h + 1, std::memory_order_release);
+        return kept;
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    bool pop(T& out) {
+        uint32_t t = tail.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t h = head.load(std::memory_order_acquire);
+            if (t == h) {
+                return false;
+            }
+
+            const Slot& slot = slots[t & (N - 1)];
+            uint32_t words[WORDS];
+            uint32_t before = slot.seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) {
+                words[i] = slot.words[i].load(std::memory_order_acquire);
+            }
+            uint32_t after = slot.seq.load(std::memory_order_relaxed);
+
+            if (before != 2 * t + 2 || after != before) {
+                // The producer has dropped entry t and is reusing its slot;
+                // the tail has already moved past it.
+                t = tail.load(std::memory_order_acquire);
+                continue;
+            }
+
+            // A failed CAS means the producer dropped entry t after we copied
+            // it; t is reloaded and the copy discarded.
+            if (tail.compare_exchange_weak(t, t + 1,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+                memcpy(&out, words, sizeof(T));
+                return true;
+            }
+        }
+    }
+
+    size_t size() const {
+        uint32_t h = head.load(std::memory_order_acquire);
+        uint32_t t = tail.load(std::memory_order_acquire);
+        return (size_t)(h - t);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return N; }
+
+    // Number of entries discarded because the ring was full
+    uint32_t droppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> words[WORDS];
+    };
+
+    Slot slots[N];
+    std::atomic<uint32_t> head;     // Written by producer only
+    std::atomic<uint32_t> tail;     // Advanced by consumer, or by producer on overflow
+    std::atomic<uint32_t> dropped;
+};
+
+#endif // EVENT_RING_H
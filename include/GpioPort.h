@@ -0,0 +1,60 @@
+#ifndef GPIO_PORT_H
+#define GPIO_PORT_H
+
+#include <Arduino.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc_caps.h>
+
+// Port-wide GPIO access through the raw input and set/clear registers.
+//
+// Pins are addressed as a 64-bit mask (bit n = GPIO n). Everything here is
+// inline and IRAM-safe, so it may be used from ISRs with the flash cache
+// disabled as well as from tasks.
+namespace GpioPort {
+
+// Snapshot of every input level, bank 0 and bank 1 read back to back
+static inline uint64_t IRAM_ATTR readInputs() {
+    uint64_t levels = REG_READ(GPIO_IN_REG);
+#if SOC_GPIO_PIN_COUNT > 32
+    levels |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+#endif
+    return levels;
+}
+
+static inline int IRAM_ATTR readLevel(uint8_t pin) {
+#if SOC_GPIO_PIN_COUNT > 32
+    if (pin >= 32) {
+        return (REG_READ(GPIO_IN1_REG) >> (pin - 32)) & 0x1;
+    }
+#endif
+    return (REG_READ(GPIO_IN_REG) >> pin) & 0x1;
+}
+
+// Drive every pin in 'mask' to the matching bit of 'levels'. Each bank takes
+// one store to the W1TS register and one to W1TC, so all rising pins of a
+// bank switch in the same cycle, and all falling pins switch in the next.
+// The set/clear registers make this safe against concurrent writers of other
+// pins without any locking.
+static inline void IRAM_ATTR write(uint64_t mask, uint64_t levels) {
+    uint64_t set = mask & levels;
+    uint64_t clear = mask & ~levels;
+    
+    if ((uint32_t)set) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)set);
+    }
+    if ((uint32_t)clear) {
+        REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)clear);
+    }
+#if SOC_GPIO_PIN_COUNT > 32
+    if (set >> 32) {
+        REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(set >> 32));
+    }
+    if (clear >> 32) {
+        REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(clear >> 32));
+    }
+#endif
+}
+
+} // namespace GpioPort
+
+#endif // GPIO_PORT_H
@@ -7,22 +7,30 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
+#include <esp_timer.h>
+#include <soc/soc_caps.h>
 #include <vector>
-#include <map>
+#include "EventRing.h"
+#include "DeadlineHeap.h"
+#include "OutputSequencer.h"
+#include "VerticalDebouncer.h"
+#include "PulseCounter.h"
+#include "AdcSampler.h"
+#include "TopicPool.h"
+#include "BoardProfile.h"
+#include "ConfigSnapshot.h"
+#include "RuleEngine.h"
+#include "EventHistory.h"
+#include "PinRecord.h"
+
+// Pin changes kept in RAM for /cmd/io/history (power of two)
+#ifndef IO_HISTORY_SIZE
+#define IO_HISTORY_SIZE 512
+#endif
 
 // Forward declaration
 class MQTTManager;
 
-// Pin modes
-enum class PinMode {
-    NONE,
-    OUTPUT_MODE,
-    INPUT_MODE,
-    INPUT_PULLUP_MODE,
-    ANALOG_MODE,
-    INTERRUPT_MODE
-};
-
 // Trigger types
 enum class TriggerType {
     NONE,
@@ -32,14 +40,6 @@ enum class TriggerType {
     TOGGLE         // Toggle pin state
 };
 
-// Interrupt edge detection
-enum class InterruptEdge {
-    NONE,
-    RISING_EDGE,
-    FALLING_EDGE,
-    CHANGE_EDGE
-};
-
 // Event types for the queue
 enum class EventType {
     DIGITAL,
@@ -52,10 +52,27 @@ struct IOEvent {
     uint8_t pin;
     EventType type;
     int value;
-    unsigned long timestamp;
+    int64_t timestamp;      // esp_timer_get_time(), microseconds since boot
 };
 
-// Pin configuration structure
+// Coalesced run of interrupt edges on one pin. A burst stays open while edges
+// keep arriving within the pin's debounce window and is published as a single
+// record once the pin goes quiet (or the burst hits MAX_BURST_US).
+struct EdgeBurst {
+    int64_t firstUs;
+    int64_t lastUs;
+    uint32_t edges;
+    int level;
+};
+
+// Pin state change collected for a batched publish
+struct PinStateChange {
+    uint8_t pin;
+    int value;
+    int64_t timestamp;      // Microseconds since boot
+};
+
+// Pin configuration structure (as parsed from a command or loaded from NVS)
 struct PinConfig {
     uint8_t pin;
     PinMode mode;
@@ -63,11 +80,87 @@ struct PinConfig {
     uint16_t debounceMs;
     uint16_t pulseWidthMs;
     uint32_t reportIntervalMs;
+    AnalogFilterConfig filter;      // Analog pins sampled by AdcSampler
+    uint16_t deadband;              // Analog: ignore changes up to this many counts
+    uint16_t deadbandPermille;      // Analog: ...or up to this share of the last value
+    uint32_t heartbeatMs;           // Analog: publish anyway after this much silence
     String reportTopic;
     bool persist;
     bool retain;
-    unsigned long lastReportTime;
-    int lastValue;
+};
+
+// Per-pin fields read for every event and report, kept together in one
+// GPIO-indexed array so the worker's lookups are a single index
+struct PinState {
+    PinMode mode;
+    InterruptEdge edge;
+    bool retain;
+    bool persist;
+    uint16_t debounceMs;
+    uint16_t topic;                 // Report topic handle in the topic pool
+    uint32_t reportIntervalMs;
+    uint16_t deadband;
+    uint16_t deadbandPermille;
+    uint32_t heartbeatMs;
+    uint32_t generation;            // Bumped on every (re)configuration
+};
+
+// Per-pin settings only needed when (re)configuring or describing a pin
+struct PinSettings {
+    uint16_t pulseWidthMs;
+    AnalogFilterConfig filter;
+};
+
+// Immutable view of the pin configuration. Published as a whole through a
+// ConfigSnapshot, so readers never see a half-applied change.
+static const size_t TOPIC_POOL_SIZE = 2048;
+
+struct PinTable {
+    uint64_t configuredMask;        // Bit n set when GPIO n is configured
+    uint64_t digitalInputMask;
+    uint64_t polledInputMask;       // input and input_pullup pins
+    PinState pins[SOC_GPIO_PIN_COUNT];
+    PinSettings settings[SOC_GPIO_PIN_COUNT];
+    TopicPool<TOPIC_POOL_SIZE, SOC_GPIO_PIN_COUNT> topics;
+    
+    const PinState* find(uint8_t pin) const {
+        if (pin >= SOC_GPIO_PIN_COUNT || !((configuredMask >> pin) & 0x1)) {
+            return nullptr;
+        }
+        return &pins[pin];
+    }
+};
+
+// Per-pin reporting state, owned by the worker task. Reset whenever the
+// pin's configuration generation changes.
+struct PinRuntime {
+    int32_t lastValue;
+    uint32_t lastReportTime;        // millis() of the last publish
+    uint32_t suppressedCount;       // Analog reports held back by the deadband
+    uint64_t counterReported;       // Counter total at the last periodic report
+    uint32_t generation;
+};
+
+// Counter total at the last on-request report of a pin (reportAllPins),
+// kept apart from the periodic report's so neither steals the other's pulses
+struct CounterBaseline {
+    uint64_t total;
+    uint32_t generation;
+};
+
+// A /cmd/io/history request being streamed back. 'cursor' and 'end' are
+// EventHistory sequence numbers.
+struct HistoryQuery {
+    bool active;
+    uint8_t pin;                    // 0xFF for every pin
+    int64_t fromUs;
+    int64_t toUs;
+    uint32_t cursor;
+    uint32_t end;
+    uint16_t chunk;                 // Index of the next chunk
+    uint8_t chunkSize;
+    bool complete;                  // False once part of the range was overwritten
+    String id;
 };
 
 class InputManager {
@@ -75,15 +168,12 @@ private:
     Preferences preferences;
     MQTTManager* mqttManager;
     
-    // Pin management
-    std::map<uint8_t, PinConfig> configuredPins;
+    // Pin management. The exclude list is kept as given for reporting and
+    // folded into excludedMask for validation; reserved pins come from the
+    // board profile.
     std::vector<uint8_t> excludedPins;
     std::vector<std::pair<uint8_t, uint8_t>> excludedRanges;
-    
-    // Default reserved pins (boot, flash, etc.)
-    const std::vector<uint8_t> RESERVED_PINS = {
-        6, 7, 8, 9, 10, 11  // SPI flash pins
-    };
+    uint64_t excludedMask;
     
     // FreeRTOS event queue and task
     QueueHandle_t eventQueue;
@@ -91,31 +181,172 @@ private:
     static const uint8_t QUEUE_SIZE = 32;
     static const uint8_t QUEUE_OVERWRITE_OLDEST = 1;
     
-    // ISR handlers map
-    static std::map<uint8_t, InputManager*> isrHandlers;
+    // ISR-to-worker event ring (lock-free SPSC, drop-oldest). The GPIO ISR
+    // dispatcher runs on a single core, so all pin interrupts share one producer.
+    static const size_t ISR_RING_SIZE = 64;
+    EventRing<IOEvent, ISR_RING_SIZE> isrEvents;
+    
+    // ISR handlers indexed by GPIO number
+    static const uint8_t MAX_PINS = SOC_GPIO_PIN_COUNT;
+    static InputManager* isrHandlers[MAX_PINS];
+    
+    // Pin configuration, written by configurePin/removePin and read by the
+    // worker and the public API through wait-free snapshots
+    ConfigSnapshot<PinTable> pinTable;
+    uint32_t nextGeneration;
+    PinRuntime runtime[MAX_PINS];
+    
+    // Edge-burst coalescing state (owned by the worker task)
+    static const int64_t MAX_BURST_US = 1000000;
+    EdgeBurst bursts[MAX_PINS];
+    uint64_t openBursts;
+    
+    // Batched state publishing. When enabled, state changes are collected and
+    // published as one message on {base}/io/batch per window or per batchMax
+    // changes, whichever comes first.
+    static const uint8_t BATCH_CAPACITY = 32;
+    PinStateChange batchBuffer[BATCH_CAPACITY];
+    uint8_t batchCount;
+    int64_t batchOpenedUs;
+    bool batchEnabled;
+    bool batchPerPin;           // Keep publishing per-pin topics as well
+    uint16_t batchWindowMs;
+    uint8_t batchMax;
+    portMUX_TYPE batchLock;
+    
+    // Periodic reporting deadlines, keyed by pin (owned by the worker task).
+    // Extra slots past the last GPIO drive the port snapshot, the
+    // debounce tick and the pulse counter poll.
+    static const uint8_t SNAPSHOT_SCHEDULE_ID = MAX_PINS;
+    static const uint8_t DEBOUNCE_SCHEDULE_ID = MAX_PINS + 1;
+    static const uint8_t COUNTER_SCHEDULE_ID = MAX_PINS + 2;
+    DeadlineHeap<MAX_PINS + 3> reportSchedule;
+    
+    // Schedule ids whose deadline must be re-armed or cancelled. Set by any
+    // task, taken by the worker; a bit can't be lost the way a queued event
+    // can when the event queue overflows.
+    static_assert(MAX_PINS + 3 <= 64, "schedule ids must fit the pending mask");
+    uint64_t pendingSchedules;
+    portMUX_TYPE scheduleLock;
+    
+    // Port-wide input snapshot mode. Digital inputs are read from the GPIO
+    // input registers in one shot and published as one packed bitmap.
+    bool snapshotEnabled;
+    uint32_t snapshotIntervalMs;
+    
+    // Tick-driven debouncing of polled digital inputs (input, input_pullup)
+    // with a non-zero debounce. All pins are sampled at once and filtered with
+    // a vertical counter. The tick never drops below DEBOUNCE_TICK_MIN_MS, so
+    // windows shorter than SAMPLES ticks are stretched to that.
+    static const uint32_t DEBOUNCE_TICK_MIN_MS = 5;
+    VerticalDebouncer debouncer;
+    uint64_t debouncedMask;     // Pins seeded into the debouncer (worker)
+    uint32_t debounceTickMs;
+    
+    // Per-pin binary records in NVS
+    PinRecordStore<Preferences> pinRecords;
+    
+    // Publishes skipped by analog deadbands, all pins
+    uint32_t suppressedPublishes;
+    
+    // Timer-driven pulses and waveforms on output pins
+    OutputSequencer sequencer;
+    
+    // Hardware pulse counters for counter-mode pins
+    PulseCounter counters;
+    CounterBaseline requestedCounters[MAX_PINS];
+    
+    // Continuous, filtered sampling of analog pins on ADC1
+    AdcSampler analogSampler;
+    
+    // Recent pin changes for backfill queries. Recorded by the worker and
+    // the command path, so guarded by historyLock.
+    static const uint8_t HISTORY_ALL_PINS = 0xFF;
+    static const uint8_t HISTORY_CHUNK_DEFAULT = 16;
+    static const uint8_t HISTORY_CHUNK_MAX = 24;
+    static const uint8_t HISTORY_SCAN_STEP = 64;   // Entries looked at per critical section
+    EventHistory<IOEvent, IO_HISTORY_SIZE> history;
+    int32_t historyLastValue[MAX_PINS];
+    portMUX_TYPE historyLock;
+    HistoryQuery historyQuery;  // Streamed one chunk per loop()
+    bool configRequested;       // cmd/io/config/get waiting for the backlog to clear
+    
+    // Local rules, compiled by setRules() and evaluated by the worker on
+    // every input change
+    static const uint8_t MAX_RULE_NESTING = 4;
+    ConfigSnapshot<RuleProgram> rules;
+    RuleEngine ruleEngine;      // Owned by the worker
+    uint32_t ruleFires;
     
     // Internal methods
     void loadConfig();
-    void saveConfig();
+    void migrateJsonConfig();
+    void savePinRecord(const PinConfig& config);
+    void erasePinRecord(uint8_t pin);
     void loadExcludeList();
     void saveExcludeList(const std::vector<uint8_t>& pins, 
                         const std::vector<std::pair<uint8_t, uint8_t>>& ranges, 
                         bool persist);
+    void loadBatchConfig();
+    void saveBatchConfig();
+    void loadSnapshotConfig();
+    void saveSnapshotConfig();
+    void registerCommands();
+    void loadRules();
+    bool applyRules(JsonArrayConst rulesArray);
+    bool compileCondition(JsonVariantConst condition, RuleInstruction* code, uint8_t& length, uint8_t depth);
+    bool parseRuleAction(JsonVariantConst config, RuleAction& action);
     
     bool isPinExcluded(uint8_t pin);
     bool isPinReserved(uint8_t pin);
     bool validatePin(uint8_t pin);
+    bool validatePinMode(uint8_t pin, PinMode mode);
+    void updateExcludedMask();
     
-    void configurePinHardware(const PinConfig& config);
+    bool parsePinConfig(JsonVariantConst config, PinConfig& pinConfig);
+    bool applyPinConfig(const PinConfig& config);
+    void releasePin(PinTable& table, uint8_t pin);
+    void requestScheduleUpdates(uint8_t pin, PinMode oldMode, PinMode newMode);
+    void publishInitialState(const PinConfig& config);
+    static const char* modeName(PinMode mode);
+    bool configurePinHardware(const PinConfig& config);
     void attachPinInterrupt(uint8_t pin, InterruptEdge edge);
     void detachPinInterrupt(uint8_t pin);
     
     static void IRAM_ATTR handleInterrupt(void* arg);
     static void workerTaskFunction(void* parameter);
     
-    void processEvent(const IOEvent& event);
-    void applyTrigger(uint8_t pin, TriggerType type, uint16_t pulseWidthMs);
-    void publishPinState(uint8_t pin, int value);
+    static void relaxWriter();
+    
+    void processEvent(const PinTable& table, const IOEvent& event);
+    PinRuntime& runtimeFor(const PinState& state, uint8_t pin);
+    static bool withinDeadband(const PinState& state, const PinRuntime& runtime, int value);
+    void coalesceEdge(const PinTable& table, const IOEvent& event);
+    void flushBursts(const PinTable& table, int64_t now);
+    void requestReportSchedule(uint8_t pin);
+    void updateReportSchedule(const PinTable& table, uint8_t pin);
+    void applyPendingSchedules(const PinTable& table);
+    void runDueReports(const PinTable& table, int64_t now);
+    static bool isDigitalInput(PinMode mode);
+    void updateDebounceTick(const PinTable& table);
+    void runDebounceTick(const PinTable& table, int64_t now);
+    int64_t nextBurstCloseUs(const PinTable& table);
+    void publishBurst(const PinTable& table, uint8_t pin, const EdgeBurst& burst, bool settled);
+    TickType_t ticksUntilNextDeadline(const PinTable& table, int64_t now);
+    bool applyTrigger(const PinTable& table, uint8_t pin, TriggerType type, uint16_t pulseWidthMs);
+    void onSequenceDone(uint64_t pinMask, uint8_t level);
+    void publishPinState(const PinTable& table, uint8_t pin, int value, int64_t timestamp = 0);
+    void publishCounter(const PinTable& table, uint8_t pin, int64_t now, uint64_t& reportedTotal);
+    void publishSnapshot(const PinTable& table);
+    void buildConfigJson(const PinTable& table, const RuleProgram& program, JsonDocument& doc);
+    void runRules(const PinTable& table, uint8_t pin, int value);
+    void recordHistory(uint8_t pin, EventType type, int value, int64_t timestamp);
+    void streamHistory();
+    void seedRuleInputs(const PinTable& table, uint64_t mask);
+    int readAnalog(uint8_t pin);
+    bool appendToBatch(uint8_t pin, int value, int64_t timestamp);
+    int64_t nextBatchFlushUs();
+    void flushBatch();
     
     bool queueEvent(const IOEvent& event);
     
@@ -137,12 +368,31 @@ public:
     void getExcludeList(std::vector<uint8_t>& pins,
                        std::vector<std::pair<uint8_t, uint8_t>>& ranges);
     
+    // Batched state publishing
+    bool setBatchConfig(const JsonDocument& config);
+    
     // Trigger operations
     bool triggerPin(uint8_t pin, const String& action, uint16_t pulseWidthMs = 100);
+    bool runWaveform(const JsonDocument& config);
+    bool writeOutputs(const JsonDocument& config);
+    
+    // Local input-to-output rules
+    bool setRules(const JsonDocument& config);
+    
+    // Stream recorded pin changes matching a pin/time range to {base}/io/history
+    bool queryHistory(const JsonDocument& query);
+    
+    // Port snapshot mode
+    bool setSnapshotConfig(const JsonDocument& config);
+    void publishSnapshot();
     
     // Status reporting
     void reportAllPins();
     String getConfigJson();
+    void publishConfig();       // Streams the IO configuration to {base}/io/config
+    uint32_t getDroppedEventCount() const;
+    uint32_t getSuppressedPublishCount() const;
+    uint32_t getRuleFireCount() const;
 };
 
 #endif // INPUT_MANAGER_H
@@ -5,7 +5,47 @@
 #include <WiFi.h>
 #include <Preferences.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include "DeviceTopics.h"
+#include "PublishQueue.h"
+#include "OutboundJournal.h"
+#include "TopicRouter.h"
+#include "PayloadEncoding.h"
 
+// Maximum MQTT packet size (topic + payload + header)
+#ifndef MQTT_BUFFER_SIZE
+#define MQTT_BUFFER_SIZE 1024
+#endif
+
+// The client's buffer also holds the fixed header (up to 5 bytes) and the
+// 2-byte topic length. A queue slot only adds the topic's NUL, so slots are
+// sized to exactly what one publish() can carry.
+#define MQTT_PUBLISH_HEADER_BYTES 7
+#define MQTT_QUEUE_SLOT_BYTES (MQTT_BUFFER_SIZE - MQTT_PUBLISH_HEADER_BYTES + 1)
+
+// Outbound messages buffered between publish() and the network (power of two)
+#ifndef MQTT_QUEUE_SLOTS
+#define MQTT_QUEUE_SLOTS 16
+#endif
+
+// Outbound queue counters
+struct PublishQueueStats {
+    uint32_t depth;         // Messages waiting now
+    uint32_t highWater;     // Most messages ever waiting at once
+    uint32_t dropped;       // Queue full or message larger than a slot
+    uint32_t failed;        // Rejected by the client while connected
+    uint32_t sent;
+};
+
+// Non-owning view of an incoming message. 'topic' is NUL-terminated,
+// 'payload' is not; both are only valid during the call. They point into
+// the manager's inbound copy rather than the client's buffer, so handlers
+// may publish (which reuses the client's buffer) before they are done.
+typedef std::function<void(const char* topic, const uint8_t* payload, size_t length)> MQTTMessageCallback;
+
+// Owning String form, kept for existing handlers; every message is copied
 typedef std::function<void(String topic, String payload)> MQTTCallback;
 
 class MQTTManager {
@@ -21,11 +61,70 @@ private:
     String clientId;
     String baseTopic;
     
-    MQTTCallback messageCallback;
-    unsigned long lastReconnectAttempt;
+    DeviceTopicTable deviceTopics;      // Built once in the constructor
+    
+    // Incoming messages go to the handler registered for their topic;
+    // messageCallback only sees topics without one
+    TopicRouter router;
+    MQTTMessageCallback messageCallback;
+    char inboundBuffer[MQTT_BUFFER_SIZE];  // Topic, NUL, payload of the message being handled
+    
+    // Broker connection. loop() schedules attempts; the connect task runs
+    // each one (DNS, TCP, CONNECT/CONNACK, SUBSCRIBE) and owns the client
+    // until it reports CONNECTED or FAILED. Failed attempts back off
+    // exponentially from RECONNECT_BACKOFF_MIN_MS to RECONNECT_BACKOFF_MAX_MS
+    // with random jitter, so a fleet that lost its broker does not come
+    // back all at once.
+    enum class ConnectState : uint8_t {
+        WAITING,            // Until nextConnectAttempt
+        RESOLVING,
+        OPENING,
+        HANDSHAKE,
+        SUBSCRIBING,
+        CONNECTED,
+        FAILED
+    };
+    static const uint32_t RECONNECT_BACKOFF_MIN_MS = 1000;
+    static const uint32_t RECONNECT_BACKOFF_MAX_MS = 60000;
+    static const uint32_t CONNECT_TIMEOUT_MS = 5000;
+    std::atomic<ConnectState> connectState;
+    TaskHandle_t connectTask;
+    unsigned long nextConnectAttempt;
+    uint8_t connectFailures;
+    bool announced;             // "online" published for this session
+    
+    // Outbound messages from any task. Only the network owner (the task
+    // running loop()) touches the client, and it drains the queue.
+    static const uint8_t MAX_SENDS_PER_LOOP = 8;
+    typedef PublishQueue<MQTT_QUEUE_SLOTS, MQTT_QUEUE_SLOT_BYTES> OutboundQueue;
+    OutboundQueue outbound;
+    TaskHandle_t ownerTask;
+    uint32_t failedCount;
+    uint32_t sentCount;
+    
+    // Optional store-and-forward journal. While offline the queue drains
+    // into flash. After a reconnect each loop() replays for up to
+    // JOURNAL_REPLAY_BUDGET_MS until the journal is empty; newer messages
+    // wait in the queue behind it and only spill to flash once the queue is
+    // more than half full.
+    static const uint32_t JOURNAL_REPLAY_BUDGET_MS = 20;
+    OutboundJournal journal;
+    bool journalEnabled;
+    uint8_t replayBuffer[MQTT_BUFFER_SIZE];
+    
+    // Outbound payload format and inbound command format (persisted)
+    PayloadEncoding encoding;
     
     void callback(char* topic, byte* payload, unsigned int length);
-    bool reconnect();
+    void registerCommands();
+    static void connectTaskFunction(void* parameter);
+    bool runConnect();
+    void scheduleReconnect();
+    bool clientReady();
+    void drainQueue(uint8_t maxMessages);
+    void replayJournal();
+    bool streamJson(const char* topic, const JsonDocument& doc, PayloadEncoding format,
+                    size_t length, bool retained);
 
 public:
     MQTTManager();
@@ -34,20 +133,58 @@ public:
     void begin();
     void loop();
     bool isConnected();
+    const String& getBaseTopic() const;
+    const char* topic(DeviceTopic id) const;
     
+    void setCallback(MQTTMessageCallback callback);
     void setCallback(MQTTCallback callback);
+    
+    // Handle messages on baseTopic/<pattern>. Patterns may use '+', a final
+    // '#' and numeric captures such as "cmd/io/{pin}/trigger".
+    bool on(const String& pattern, TopicHandler handler);
     void setServer(const String& server, int port);
     void setCredentials(const String& user, const String& password);
     
     bool loadConfig();
     void saveConfig(const String& server, int port, const String& user, const String& password);
     
+    // Queue a message for sending; safe from any task and never blocks. The
+    // message is copied into the queue, so the raw form works with stack
+    // buffers and allocates nothing.
     void publish(const String& topic, const String& payload, bool retained = false);
+    void publish(const char* topic, const char* payload, size_t length, bool retained = false);
+    
+    // Serialize a document in the payload encoding, without an intermediate
+    // buffer. Messages that fit a queue slot are written straight into it;
+    // larger ones are streamed to the socket in chunks, which is only
+    // possible on the task running loop() while connected and with no
+    // backlog. Returns false if the message was dropped.
+    bool publishJson(const char* topic, const JsonDocument& doc, bool retained = false);
+    
+    // Older messages are still waiting in the queue or the journal, so a
+    // message too large to queue cannot be streamed yet
+    bool hasBacklog() const;
+    
+    // A single number: decimal text, or a MessagePack integer
+    void publishValue(const char* topic, int32_t value, bool retained = false);
     void subscribe(const String& topic);
     
+    void publishStatus(const char* status);
     void publishStatus(const String& status);
     void publishConfig(const String& config);
     void publishSignalStrength(int rssi);
+    
+    PublishQueueStats getQueueStats() const;
+    
+    // Buffer publishes on flash while disconnected (persisted)
+    bool setJournalEnabled(bool enabled);
+    bool isJournalEnabled() const;
+    JournalStats getJournalStats() const;
+    
+    // Payload encoding for telemetry and commands (persisted)
+    bool setEncoding(const char* name);
+    PayloadEncoding getEncoding() const;
+    DeserializationError decode(JsonDocument& doc, const char* payload, size_t length) const;
 };
 
 #endif // MQTT_MANAGER_H
@@ -5,9 +5,11 @@
 #include <WiFiClientSecure.h>
 #include <mbedtls/sha256.h>
 #include <ArduinoJson.h>
+#include "PayloadEncoding.h"
 
-// Forward declaration for callback
-typedef std::function<void(const String& status)> OTAStatusCallback;
+// Receives each status report as a document so the publisher can encode it
+// once in the device's payload encoding
+typedef std::function<void(const JsonDocument& status)> OTAStatusCallback;
 
 class OTAManager {
 private:
@@ -17,7 +19,8 @@ private:
     
     bool verifyIntegrity(const String& integrity);
     void publishProgress(int progress);
-    void publishStatus(const String& status);
+    void publishStatus(const JsonDocument& doc);
+    void publishStatus(const char* status, const char* message = nullptr);
 
 public:
     OTAManager();
@@ -27,8 +30,9 @@ public:
     bool isUpdateInProgress();
     void setStatusCallback(OTAStatusCallback callback);
     
-    // Handle OTA update command from MQTT
-    void handleUpdateCommand(const String& payload);
+    // Handle OTA update command from MQTT (payload need not be NUL-terminated)
+    void handleUpdateCommand(const char* payload, size_t length,
+                             PayloadEncoding encoding = PayloadEncoding::JSON);
 };
 
 #endif // OTA_MANAGER_H
@@ -0,0 +1,112 @@
+#ifndef OUTBOUND_JOURNAL_H
+#define OUTBOUND_JOURNAL_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Size at which the active journal segment is closed and a new one started
+#ifndef MQTT_JOURNAL_SEGMENT_BYTES
+#define MQTT_JOURNAL_SEGMENT_BYTES 16384
+#endif
+
+// Most segments kept on flash; the oldest is discarded to make room
+#ifndef MQTT_JOURNAL_SEGMENTS
+#define MQTT_JOURNAL_SEGMENTS 8
+#endif
+
+// Journal counters
+struct JournalStats {
+    uint32_t segments;          // Segment files holding unsent messages
+    uint32_t appended;
+    uint32_t replayed;
+    uint32_t droppedSegments;   // Discarded to stay under the capacity cap
+    uint32_t writeErrors;
+};
+
+// Append-only store-and-forward log of outbound MQTT messages on LittleFS.
+//
+// Messages are appended to numbered segment files (/mqttj/<n>.log). Each
+// record is a small header with a magic number and a CRC32 over the header
+// and message, so a record torn by a power loss ends its segment instead of
+// replaying garbage. Records are only ever appended: the writer rolls over
+// to a fresh file once MQTT_JOURNAL_SEGMENT_BYTES is reached, and a closed
+// segment is deleted as a whole once it has been replayed. Replay reads the
+// segment still being written through the writer's own handle, and each
+// time it catches up that segment is truncated in place so it keeps its
+// number. Truncation frees the blocks the segment used, so every catch-up
+// costs up to one erase per block written since the last one; during short
+// outages that is the dominant wear. At most MQTT_JOURNAL_SEGMENTS exist at
+// once; when the cap is hit the oldest segment is dropped.
+//
+// Replay is at-least-once: progress inside a segment lives in RAM, so after
+// a reboot a partly replayed segment is sent again from its start. Not
+// thread-safe; only the MQTT network owner uses it.
+class OutboundJournal {
+public:
+    struct Record {
+        const char* topic;
+        const uint8_t* payload;
+        size_t payloadLength;
+        bool retained;
+    };
+    
+    OutboundJournal();
+    
+    // Mount LittleFS (formatting it if needed) and pick up segments left
+    // from before a restart
+    bool begin();
+    bool isOpen() const { return mounted; }
+    
+    // Anything waiting to be replayed. Once replay has caught up with the
+    // segment still being written, nothing is pending until the next append.
+    bool pending() const {
+        return mounted && readSegment != nextSegment &&
+               !(writer && readSegment == nextSegment - 1 && readOffset >= writerBytes);
+    }
+    
+    bool append(const char* topic, const uint8_t* payload, size_t payloadLength, bool retained);
+    
+    // Commit appended records to flash
+    void flush();
+    
+    // Oldest unsent record, decoded into 'buffer' and valid until the next
+    // call. consume() marks it sent; without it the same record comes back.
+    bool peek(Record& record, uint8_t* buffer, size_t bufferSize);
+    void consume();
+    
+    JournalStats getStats() const;
+
+private:
+    static const uint16_t RECORD_MAGIC = 0x4A52;
+    
+    struct RecordHeader {
+        uint16_t magic;
+        uint16_t topicLength;
+        uint16_t payloadLength;
+        uint8_t flags;              // Bit 0: retained
+        uint8_t reserved;
+        uint32_t crc;               // Over the fields above, topic and payload
+    };
+    
+    bool mounted;
+    uint32_t readSegment;           // Oldest segment on flash
+    uint32_t nextSegment;           // Number the next new segment gets
+    File writer;                    // Open (read/write) on nextSegment - 1 while appending
+    size_t writerBytes;
+    File reader;                    // Open on readSegment while replaying a closed segment
+    size_t readOffset;
+    size_t peekedEnd;
+    
+    uint32_t appendedCount;
+    uint32_t replayedCount;
+    uint32_t droppedSegments;
+    uint32_t writeErrors;
+    
+    static void segmentPath(uint32_t segment, char* path, size_t size);
+    static uint32_t recordCrc(const RecordHeader& header, const uint8_t* topic, const uint8_t* payload);
+    bool openWriter();
+    void closeWriter();
+    void finishReadSegment();
+};
+
+#endif // OUTBOUND_JOURNAL_H
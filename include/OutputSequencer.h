@@ -0,0 +1,80 @@
+#ifndef OUTPUT_SEQUENCER_H
+#define OUTPUT_SEQUENCER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <functional>
+
+// One step of an output waveform: drive the pins to 'level' and hold it
+struct WaveformStep {
+    uint8_t level;
+    uint32_t durationUs;
+};
+
+// Called when a sequence finishes, with the pins it drove and the idle level
+// they were left at. Runs on the esp_timer task.
+typedef std::function<void(uint64_t pinMask, uint8_t level)> SequenceDoneCallback;
+
+// Timer-driven output sequencer.
+//
+// Plays pulses and multi-step waveforms on groups of output pins without
+// blocking the caller. All active sequences share a single one-shot esp_timer
+// that is re-armed for the earliest pending step, and step deadlines are
+// absolute so timing does not drift over long pulse trains. The deadline is
+// picked under the spinlock but the timer is armed after leaving it, since
+// esp_timer calls take their own lock and may block.
+class OutputSequencer {
+public:
+    static const uint8_t MAX_SEQUENCES = 8;
+    static const uint8_t MAX_STEPS = 16;
+    
+    OutputSequencer();
+    ~OutputSequencer();
+    
+    bool begin();
+    void setDoneCallback(SequenceDoneCallback callback);
+    
+    // Play 'steps' on every pin in pinMask, 'repeat' times (0 = until
+    // cancelled), then leave the pins at idleLevel. Any running sequence that
+    // shares a pin with the new one is cancelled first. False if no slot is
+    // free or the timer could not be armed.
+    bool start(uint64_t pinMask, const WaveformStep* steps, uint8_t stepCount,
+               uint32_t repeat, uint8_t idleLevel);
+    
+    // Single HIGH pulse of widthUs, returning to LOW
+    bool pulse(uint8_t pin, uint32_t widthUs);
+    
+    // Stop sequences touching any of these pins, leaving outputs as they are
+    void cancel(uint64_t pinMask);
+    
+    bool isBusy(uint8_t pin);
+
+private:
+    struct Sequence {
+        bool active;
+        uint64_t pinMask;
+        WaveformStep steps[MAX_STEPS];
+        uint8_t stepCount;
+        uint8_t currentStep;
+        uint32_t repeat;
+        uint32_t iteration;
+        uint8_t idleLevel;
+        int64_t nextUs;         // Deadline of the next step transition
+    };
+    
+    Sequence sequences[MAX_SEQUENCES];
+    esp_timer_handle_t timer;
+    portMUX_TYPE lock;
+    uint32_t armTicket;         // Bumped whenever a deadline is picked
+    SequenceDoneCallback doneCallback;
+    
+    static void timerCallback(void* arg);
+    void service();
+    int64_t nextDeadlineLocked(uint32_t& ticket);
+    bool arm(int64_t next, uint32_t ticket);
+    void cancelLocked(uint64_t pinMask);
+    void writePins(uint64_t pinMask, uint8_t level);
+};
+
+#endif // OUTPUT_SEQUENCER_H
@@ -0,0 +1,59 @@
+#ifndef PAYLOAD_ENCODING_H
+#define PAYLOAD_ENCODING_H
+
+#include <ArduinoJson.h>
+#include <cstring>
+
+// Wire format of MQTT payloads. MessagePack (ArduinoJson's binary
+// serializer) carries the same documents as JSON in fewer bytes; plain
+// values such as pin states and status strings become MessagePack scalars.
+// ArduinoJson 6 has no CBOR serializer, so CBOR is not offered.
+enum class PayloadEncoding : uint8_t {
+    JSON,
+    MSGPACK
+};
+
+inline const char* encodingName(PayloadEncoding encoding) {
+    return encoding == PayloadEncoding::MSGPACK ? "msgpack" : "json";
+}
+
+// Accepts "json" or "msgpack"
+inline bool parseEncoding(const char* name, PayloadEncoding& encoding) {
+    if (strcmp(name, "json") == 0) {
+        encoding = PayloadEncoding::JSON;
+    } else if (strcmp(name, "msgpack") == 0) {
+        encoding = PayloadEncoding::MSGPACK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline size_t measurePayload(PayloadEncoding encoding, const JsonDocument& doc) {
+    return encoding == PayloadEncoding::MSGPACK ? measureMsgPack(doc) : measureJson(doc);
+}
+
+// Output is anything ArduinoJson can write to (a Print on the device)
+template <typename Output>
+inline size_t encodePayload(PayloadEncoding encoding, const JsonDocument& doc, Output& out) {
+    return encoding == PayloadEncoding::MSGPACK ? serializeMsgPack(doc, out) : serializeJson(doc, out);
+}
+
+// Decode a command payload. In MessagePack mode a payload that starts like a
+// JSON object is still read as JSON, so existing tools (and the command that
+// switches back) keep working.
+inline DeserializationError decodePayload(PayloadEncoding encoding, JsonDocument& doc,
+                                          const char* payload, size_t length) {
+    if (encoding == PayloadEncoding::MSGPACK) {
+        size_t i = 0;
+        while (i < length && (payload[i] == ' ' || payload[i] == '\t' || payload[i] == '\r' || payload[i] == '\n')) {
+            i++;
+        }
+        if (i == length || payload[i] != '{') {
+            return deserializeMsgPack(doc, payload, length);
+        }
+    }
+    return deserializeJson(doc, payload, length);
+}
+
+#endif // PAYLOAD_ENCODING_H
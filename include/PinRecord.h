@@ -0,0 +1,228 @@
+#ifndef PIN_RECORD_H
+#define PIN_RECORD_H
+
+#include <ArduinoJson.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "AnalogFilter.h"
+
+// Pin modes (stored in pin records, so values are never reused)
+enum class PinMode : uint8_t {
+    NONE,
+    OUTPUT_MODE,
+    INPUT_MODE,
+    INPUT_PULLUP_MODE,
+    ANALOG_MODE,
+    INTERRUPT_MODE,
+    COUNTER_MODE    // Hardware pulse counting (PCNT)
+};
+
+// Interrupt edge detection (stored in pin records)
+enum class InterruptEdge : uint8_t {
+    NONE,
+    RISING_EDGE,
+    FALLING_EDGE,
+    CHANGE_EDGE
+};
+
+// Persisted form of a PinConfig: one fixed-size binary NVS entry per pin
+// (key "p<pin>"). Fields are only ever appended; a layout change bumps
+// PIN_RECORD_VERSION.
+static const uint8_t PIN_RECORD_VERSION = 1;
+static const size_t PIN_RECORD_TOPIC_SIZE = 128;
+
+struct PinRecord {
+    uint8_t version;
+    uint8_t pin;
+    uint8_t mode;               // PinMode
+    uint8_t edge;               // InterruptEdge
+    uint16_t debounceMs;
+    uint16_t pulseWidthMs;
+    uint32_t reportIntervalMs;
+    uint32_t heartbeatMs;
+    uint16_t deadband;
+    uint16_t deadbandPermille;
+    AnalogFilterConfig filter;
+    uint8_t retain;
+    uint8_t reserved[3];
+    char reportTopic[PIN_RECORD_TOPIC_SIZE];
+};
+static_assert(sizeof(PinRecord) == 28 + PIN_RECORD_TOPIC_SIZE, "PinRecord layout changed");
+
+// Bitmask of the pins that have a record
+static const char* const PIN_INDEX_KEY = "pidx";
+
+// JSON list of every pin, written by firmware before the binary records
+static const char* const PIN_JSON_KEY = "pins";
+
+inline void pinRecordKey(uint8_t pin, char* key, size_t size) {
+    snprintf(key, size, "p%u", pin);
+}
+
+// Config is PinConfig on the device; anything with the same fields and a
+// reportTopic offering c_str() works. Unused bytes are zeroed, so the same
+// configuration always packs to the same record.
+template <typename Config>
+inline void packPinRecord(const Config& config, PinRecord& record) {
+    memset(&record, 0, sizeof(record));
+    record.version = PIN_RECORD_VERSION;
+    record.pin = config.pin;
+    record.mode = (uint8_t)config.mode;
+    record.edge = (uint8_t)config.edge;
+    record.debounceMs = config.debounceMs;
+    record.pulseWidthMs = config.pulseWidthMs;
+    record.reportIntervalMs = config.reportIntervalMs;
+    record.heartbeatMs = config.heartbeatMs;
+    record.deadband = config.deadband;
+    record.deadbandPermille = config.deadbandPermille;
+    record.filter = config.filter;
+    record.retain = config.retain ? 1 : 0;
+    strncpy(record.reportTopic, config.reportTopic.c_str(), PIN_RECORD_TOPIC_SIZE - 1);
+}
+
+template <typename Config>
+inline void unpackPinRecord(const PinRecord& record, Config& config) {
+    config.pin = record.pin;
+    config.mode = (PinMode)record.mode;
+    config.edge = (InterruptEdge)record.edge;
+    config.debounceMs = record.debounceMs;
+    config.pulseWidthMs = record.pulseWidthMs;
+    config.reportIntervalMs = record.reportIntervalMs;
+    config.filter = record.filter;
+    config.deadband = record.deadband;
+    config.deadbandPermille = record.deadbandPermille;
+    config.heartbeatMs = record.heartbeatMs;
+    config.reportTopic = record.reportTopic;
+    config.persist = true;
+    config.retain = record.retain != 0;
+}
+
+// Checks a record read back for 'pin' before it is unpacked. Also makes sure
+// the topic is terminated.
+inline bool pinRecordValid(PinRecord& record, uint8_t pin) {
+    record.reportTopic[PIN_RECORD_TOPIC_SIZE - 1] = '\0';
+    
+    if (record.version != PIN_RECORD_VERSION || record.pin != pin ||
+        record.mode > (uint8_t)PinMode::COUNTER_MODE ||
+        record.edge > (uint8_t)InterruptEdge::CHANGE_EDGE) {
+        return false;
+    }
+    if (record.mode == (uint8_t)PinMode::ANALOG_MODE && !AnalogFilter::isValid(record.filter)) {
+        return false;
+    }
+    return record.reportTopic[0] != '\0';
+}
+
+enum class PinRecordWrite : uint8_t {
+    UNCHANGED,      // Same bytes already stored, nothing written
+    WRITTEN,
+    FAILED
+};
+
+// The pin records and their index in a key/value store. Store is
+// Preferences on the device; anything with the same get/put calls works.
+template <typename Store>
+class PinRecordStore {
+public:
+    // Capacity of the document the JSON list is parsed into
+    static const size_t JSON_CAPACITY = 2048;
+    
+    explicit PinRecordStore(Store& store) : store(store), persisted(0) {}
+    
+    // Reads the index; the store must be open
+    void begin() {
+        persisted = store.getULong64(PIN_INDEX_KEY, 0);
+    }
+    
+    // Pins that have a record
+    uint64_t pins() const { return persisted; }
+    
+    // False if the record is missing, the wrong size or fails pinRecordValid
+    bool read(uint8_t pin, PinRecord& record) {
+        char key[8];
+        pinRecordKey(pin, key, sizeof(key));
+        if (store.getBytesLength(key) != sizeof(PinRecord) ||
+            store.getBytes(key, &record, sizeof(record)) != sizeof(record)) {
+            return false;
+        }
+        return pinRecordValid(record, pin);
+    }
+    
+    // Writes the record and adds it to the index. Re-saving identical
+    // contents costs no flash write.
+    PinRecordWrite write(const PinRecord& record) {
+        char key[8];
+        pinRecordKey(record.pin, key, sizeof(key));
+        uint64_t bit = 1ULL << record.pin;
+        
+        if (persisted & bit) {
+            PinRecord existing;
+            if (store.getBytes(key, &existing, sizeof(existing)) == sizeof(existing) &&
+                memcmp(&existing, &record, sizeof(record)) == 0) {
+                return PinRecordWrite::UNCHANGED;
+            }
+        }
+        
+        if (store.putBytes(key, &record, sizeof(record)) != sizeof(record)) {
+            return PinRecordWrite::FAILED;
+        }
+        
+        if (!(persisted & bit)) {
+            persisted |= bit;
+            store.putULong64(PIN_INDEX_KEY, persisted);
+        }
+        return PinRecordWrite::WRITTEN;
+    }
+    
+    void erase(uint8_t pin) {
+        uint64_t bit = 1ULL << pin;
+        if (!(persisted & bit)) {
+            return;
+        }
+        
+        char key[8];
+        pinRecordKey(pin, key, sizeof(key));
+        store.remove(key);
+        
+        persisted &= ~bit;
+        store.putULong64(PIN_INDEX_KEY, persisted);
+    }
+    
+    bool hasJson() {
+        return store.isKey(PIN_JSON_KEY);
+    }
+    
+    // One-time conversion of the JSON list into records. Each entry goes
+    // through convert(JsonVariantConst entry, PinRecord& record), which
+    // returns false to skip it. The list is deleted afterwards even if it
+    // could not be parsed. Returns the number of records written, or -1 on a
+    // parse error.
+    template <typename Convert>
+    int migrateJson(Convert convert) {
+        auto json = store.getString(PIN_JSON_KEY, "");
+        
+        int migrated = -1;
+        StaticJsonDocument<JSON_CAPACITY> doc;
+        if (!deserializeJson(doc, json.c_str(), json.length())) {
+            migrated = 0;
+            JsonArrayConst entries = doc["pins"];
+            for (JsonVariantConst entry : entries) {
+                PinRecord record;
+                if (convert(entry, record) && write(record) != PinRecordWrite::FAILED) {
+                    migrated++;
+                }
+            }
+        }
+        
+        store.remove(PIN_JSON_KEY);
+        return migrated;
+    }
+
+private:
+    Store& store;
+    uint64_t persisted;
+};
+
+#endif // PIN_RECORD_H
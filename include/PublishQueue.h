@@ -0,0 +1,150 @@
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Bounded multi-producer/single-consumer queue of outbound MQTT messages.
+//
+// Every slot is pre-allocated and holds the NUL-terminated topic followed by
+// the payload, so enqueueing never allocates and never blocks: a producer
+// claims a slot with one compare-and-swap, copies the message in and
+// releases it to the consumer through the slot's sequence number (Vyukov's
+// bounded queue). When every slot is taken the message is dropped and
+// counted. The consumer reads messages in place and frees the slot once the
+// message is written.
+template <size_t SLOTS, size_t SLOT_BYTES>
+class PublishQueue {
+    static_assert(SLOTS >= 2 && (SLOTS & (SLOTS - 1)) == 0, "PublishQueue size must be a power of two");
+    static_assert(SLOT_BYTES < 0xFFFF, "PublishQueue lengths are 16-bit");
+
+public:
+    struct Message {
+        const char* topic;
+        const uint8_t* payload;
+        size_t payloadLength;
+        bool retained;
+    };
+    
+    PublishQueue() : enqueuePos(0), dequeuePos(0), highWater(0), dropped(0) {
+        for (size_t i = 0; i < SLOTS; i++) {
+            slots[i].sequence.store((uint32_t)i, std::memory_order_relaxed);
+        }
+    }
+    
+    // Producer side, any task. Returns false (and counts a drop) when the
+    // queue is full or the message does not fit in a slot.
+    bool push(const char* topic, const uint8_t* payload, size_t payloadLength, bool retained) {
+        return push(topic, payloadLength, retained, [payload, payloadLength](uint8_t* slotPayload) {
+            memcpy(slotPayload, payload, payloadLength);
+        });
+    }
+    
+    // As above, but 'fill(uint8_t* payload)' writes the payloadLength bytes
+    // straight into the claimed slot, e.g. to serialize without a buffer
+    template <typename Fill>
+    bool push(const char* topic, size_t payloadLength, bool retained, Fill fill) {
+        size_t topicLength = strlen(topic);
+        if (!fits(topicLength, payloadLength)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        
+        Slot* slot;
+        uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &slots[pos & (SLOTS - 1)];
+            int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        
+        memcpy(slot->data, topic, topicLength + 1);
+        fill(reinterpret_cast<uint8_t*>(slot->data + topicLength + 1));
+        slot->topicLength = (uint16_t)topicLength;
+        slot->payloadLength = (uint16_t)payloadLength;
+        slot->retained = retained;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        
+        noteDepth(pos + 1 - dequeuePos.load(std::memory_order_relaxed));
+        return true;
+    }
+    
+    // Consumer side. The oldest message, valid until pop(); false when the
+    // queue is empty or its oldest slot is still being filled.
+    bool front(Message& message) {
+        uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+        const Slot& slot = slots[pos & (SLOTS - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        
+        message.topic = slot.data;
+        message.payload = reinterpret_cast<const uint8_t*>(slot.data + slot.topicLength + 1);
+        message.payloadLength = slot.payloadLength;
+        message.retained = slot.retained;
+        return true;
+    }
+    
+    // Consumer side. Frees the slot returned by front().
+    void pop() {
+        uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+        slots[pos & (SLOTS - 1)].sequence.store(pos + SLOTS, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    }
+    
+    // Messages claimed but not yet written out
+    size_t depth() const {
+        uint32_t head = enqueuePos.load(std::memory_order_relaxed);
+        uint32_t tail = dequeuePos.load(std::memory_order_relaxed);
+        return (size_t)(head - tail);
+    }
+    
+    size_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+    uint32_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    
+    static constexpr size_t capacity() { return SLOTS; }
+    
+    static constexpr bool fits(size_t topicLength, size_t payloadLength) {
+        return topicLength + 1 + payloadLength <= SLOT_BYTES;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        uint16_t topicLength;
+        uint16_t payloadLength;
+        bool retained;
+        char data[SLOT_BYTES];
+    };
+    
+    Slot slots[SLOTS];
+    std::atomic<uint32_t> enqueuePos;
+    std::atomic<uint32_t> dequeuePos;   // Advanced by the consumer only
+    std::atomic<uint32_t> highWater;
+    std::atomic<uint32_t> dropped;
+    
+    void noteDepth(uint32_t depth) {
+        // The consumer frees a slot just before advancing dequeuePos, so a
+        // racing producer can briefly see one too many
+        if (depth > SLOTS) {
+            depth = SLOTS;
+        }
+        uint32_t seen = highWater.load(std::memory_order_relaxed);
+        while (depth > seen &&
+               !highWater.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+#endif // PUBLISH_QUEUE_H
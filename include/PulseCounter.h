@@ -0,0 +1,74 @@
+#ifndef PULSE_COUNTER_H
+#define PULSE_COUNTER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <soc/soc_caps.h>
+#if SOC_PCNT_SUPPORTED
+#include <driver/pcnt.h>
+#endif
+
+// Snapshot of one counter pin. Readers that report deltas keep their own
+// copy of the last total they reported.
+struct CounterReading {
+    uint64_t total;     // Pulses since the pin was configured
+    float hz;           // Pulse rate over the sliding window
+};
+
+// Hardware pulse counting on top of the PCNT peripheral.
+//
+// Each counter pin gets its own PCNT unit, so edges are counted in hardware
+// with no interrupt or CPU work per pulse. The 16-bit hardware counters are
+// polled every POLL_INTERVAL_MS and folded into 64-bit totals; as long as a
+// unit wraps at most once between polls the totals are exact, which holds up
+// to COUNTER_LIMIT / POLL_INTERVAL_MS pulses per millisecond (~327 kHz).
+// Chips without PCNT (ESP32-C3) refuse every attach().
+class PulseCounter {
+public:
+#if SOC_PCNT_SUPPORTED
+    static const uint8_t MAX_CHANNELS = PCNT_UNIT_MAX;
+#else
+    static const uint8_t MAX_CHANNELS = 1;
+#endif
+    static const uint32_t POLL_INTERVAL_MS = 100;
+    static const uint8_t WINDOW_SAMPLES = 10;       // Rate window = 1 s of polls
+    static const int16_t COUNTER_LIMIT = 32767;     // Unit resets to 0 here
+    
+    PulseCounter();
+    ~PulseCounter();
+    
+    // Start counting edges on pin in a free PCNT unit
+    bool attach(uint8_t pin, bool countRising, bool countFalling);
+    void detach(uint8_t pin);
+    bool isActive() const;
+    
+    // Fold the hardware counts into the totals and record a rate sample.
+    // Must be called at least once per wrap period (POLL_INTERVAL_MS).
+    void poll(int64_t now);
+    
+    // Latest total and rate for pin. Reading has no side effects, so any
+    // number of reporters can share a counter.
+    bool read(uint8_t pin, int64_t now, CounterReading& reading);
+
+private:
+    struct Channel {
+        bool active;
+        uint8_t pin;
+        int16_t lastRaw;
+        uint64_t total;
+        int64_t windowUs[WINDOW_SAMPLES];
+        uint64_t windowTotal[WINDOW_SAMPLES];
+        uint8_t windowHead;
+        uint8_t windowCount;
+    };
+    
+    Channel channels[MAX_CHANNELS];
+    uint8_t activeCount;
+    portMUX_TYPE lock;
+    
+    int findChannel(uint8_t pin);
+    void accumulate(uint8_t unit);
+    float rateLocked(const Channel& channel, int64_t now);
+};
+
+#endif // PULSE_COUNTER_H
@@ -0,0 +1,115 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Local input-to-output rules, compiled to a small postfix bytecode.
+//
+// Each rule is a boolean condition over input pins plus an action to run
+// when the condition becomes true (and optionally one for when it stops
+// being true). Conditions are flat instruction lists evaluated on a tiny
+// bool stack: leaves push a pin test, AND/OR combine the top n entries, NOT
+// inverts the top. Evaluation touches only the rules that reference the pin
+// that changed and allocates nothing.
+
+// Edge ops avoid the Arduino RISING/FALLING/CHANGE macros
+enum class RuleOp : uint8_t {
+    LEVEL,      // Input equals arg (0/1)
+    ROSE,       // This event is a 0 -> 1 transition of the pin
+    FELL,       // This event is a 1 -> 0 transition of the pin
+    CHANGED,    // This event changed the pin's value
+    ABOVE,      // Input greater than arg
+    BELOW,      // Input less than arg
+    AND,        // All of the top arg entries
+    OR,         // Any of the top arg entries
+    NOT
+};
+
+enum class RuleActionType : uint8_t {
+    NONE,
+    SET,
+    RESET,
+    PULSE,
+    TOGGLE
+};
+
+struct RuleInstruction {
+    RuleOp op;
+    uint8_t pin;
+    uint16_t arg;
+};
+
+struct RuleAction {
+    RuleActionType type;
+    uint8_t pin;
+    uint16_t pulseMs;
+};
+
+struct Rule {
+    uint16_t start;             // First instruction in RuleProgram::code
+    uint8_t length;
+    RuleAction onTrue;
+    RuleAction onFalse;
+    uint64_t pins;              // Inputs the condition reads
+};
+
+// An immutable set of compiled rules
+struct RuleProgram {
+    static const uint8_t MAX_RULES = 16;
+    static const uint16_t MAX_CODE = 128;
+    static const uint8_t MAX_STACK = 8;
+    
+    uint32_t version;           // Changes whenever the rules are replaced
+    uint8_t ruleCount;
+    uint16_t codeLength;
+    uint64_t inputMask;         // Union of every rule's pins
+    Rule rules[MAX_RULES];
+    RuleInstruction code[MAX_CODE];
+    
+    void clear();
+    
+    // Append a rule. Fails if the program is full or the condition does not
+    // leave exactly one value on the stack.
+    bool addRule(const RuleInstruction* condition, uint8_t length,
+                 const RuleAction& onTrue, const RuleAction& onFalse);
+};
+
+// Evaluates a RuleProgram against the stream of input values. Owned by a
+// single task.
+class RuleEngine {
+public:
+    static const uint8_t MAX_PINS = 64;
+    
+    RuleEngine();
+    
+    // Record an input value without evaluating anything
+    void setValue(uint8_t pin, int32_t value);
+    int32_t value(uint8_t pin) const { return pin < MAX_PINS ? values[pin] : -1; }
+    
+    // True until reset() has been called for this program
+    bool needsReset(const RuleProgram& program) const { return program.version != loadedVersion; }
+    
+    // Take the current values as the baseline for a new program, so only
+    // later changes fire actions
+    void reset(const RuleProgram& program);
+    
+    // Feed a new value for 'pin'. Rules whose condition changed append their
+    // action to 'fired'; returns the number of actions. Each edge is an event
+    // of its own, so a rule held true by an edge term fires again on the next
+    // edge that keeps it true (e.g. "change" on every toggle).
+    uint8_t update(const RuleProgram& program, uint8_t pin, int32_t value,
+                   RuleAction* fired, uint8_t maxFired);
+
+private:
+    static const uint8_t NO_PIN = 0xFF;
+    
+    int32_t values[MAX_PINS];   // -1 while unknown
+    uint32_t results;           // Last result per rule, bit n = rule n
+    uint32_t loadedVersion;
+    
+    // 'edge' is set when a ROSE/FELL/CHANGED term matched this event
+    bool evaluate(const RuleProgram& program, const Rule& rule, uint8_t pin, int32_t previous, bool& edge) const;
+};
+
+#endif // RULE_ENGINE_H
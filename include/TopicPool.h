@@ -0,0 +1,118 @@
+#ifndef TOPIC_POOL_H
+#define TOPIC_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Interned, reference-counted strings in one fixed arena.
+//
+// Equal strings share a single copy and are addressed by a small handle, so
+// many pins reporting under the same topic cost the bytes once, and nothing
+// is allocated on the heap. Released space is reclaimed by compacting the
+// arena when a new string does not fit; handles stay valid across
+// compaction.
+template <size_t ARENA_SIZE, size_t SLOTS>
+class TopicPool {
+    static_assert(ARENA_SIZE < 0xFFFF && SLOTS < 0xFFFF, "TopicPool offsets are 16-bit");
+
+public:
+    static const uint16_t INVALID = 0xFFFF;
+    
+    TopicPool() : top(0) {
+        for (size_t i = 0; i < SLOTS; i++) {
+            refs[i] = 0;
+        }
+    }
+    
+    // Handle for 'text', sharing an existing copy when there is one.
+    // Returns INVALID when the arena or the slot table is full.
+    uint16_t intern(const char* text) {
+        size_t length = strlen(text);
+        int freeSlot = -1;
+        
+        for (size_t i = 0; i < SLOTS; i++) {
+            if (refs[i] == 0) {
+                if (freeSlot < 0) {
+                    freeSlot = (int)i;
+                }
+                continue;
+            }
+            if (lengths[i] == length && memcmp(&arena[offsets[i]], text, length) == 0) {
+                refs[i]++;
+                return (uint16_t)i;
+            }
+        }
+        
+        if (freeSlot < 0) {
+            return INVALID;
+        }
+        if (top + length + 1 > ARENA_SIZE) {
+            compact();
+            if (top + length + 1 > ARENA_SIZE) {
+                return INVALID;
+            }
+        }
+        
+        memcpy(&arena[top], text, length + 1);
+        offsets[freeSlot] = (uint16_t)top;
+        lengths[freeSlot] = (uint16_t)length;
+        refs[freeSlot] = 1;
+        top += length + 1;
+        return (uint16_t)freeSlot;
+    }
+    
+    void release(uint16_t id) {
+        if (id < SLOTS && refs[id] > 0) {
+            refs[id]--;
+        }
+    }
+    
+    // The interned string, or "" for INVALID/released handles
+    const char* get(uint16_t id) const {
+        if (id >= SLOTS || refs[id] == 0) {
+            return "";
+        }
+        return &arena[offsets[id]];
+    }
+    
+    size_t length(uint16_t id) const {
+        return (id < SLOTS && refs[id] > 0) ? lengths[id] : 0;
+    }
+    
+    // Arena bytes in use, including space not yet reclaimed
+    size_t used() const { return top; }
+
+private:
+    char arena[ARENA_SIZE];
+    uint16_t offsets[SLOTS];
+    uint16_t lengths[SLOTS];
+    uint8_t refs[SLOTS];
+    size_t top;
+    
+    void compact() {
+        // Slide live strings down in arena order, closing the gaps
+        size_t write = 0;
+        while (true) {
+            int next = -1;
+            for (size_t i = 0; i < SLOTS; i++) {
+                if (refs[i] > 0 && offsets[i] >= write &&
+                    (next < 0 || offsets[i] < offsets[next])) {
+                    next = (int)i;
+                }
+            }
+            if (next < 0) {
+                break;
+            }
+            size_t size = lengths[next] + 1;
+            if (offsets[next] != write) {
+                memmove(&arena[write], &arena[offsets[next]], size);
+                offsets[next] = (uint16_t)write;
+            }
+            write += size;
+        }
+        top = write;
+    }
+};
+
+#endif // TOPIC_POOL_H
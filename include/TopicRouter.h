@@ -0,0 +1,98 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+// Levels captured while matching a topic, in pattern order. Text captures
+// point into the topic and are not NUL-terminated.
+struct TopicMatch {
+    static const uint8_t MAX_CAPTURES = 4;
+    
+    uint8_t count;
+    const char* captureStart[MAX_CAPTURES];
+    uint16_t captureLength[MAX_CAPTURES];
+    uint32_t captureValue[MAX_CAPTURES];    // {name} captures only
+    
+    uint32_t number(uint8_t index) const { return index < count ? captureValue[index] : 0; }
+};
+
+// 'payload' is not NUL-terminated and is only valid during the call. The
+// caller keeps it, the topic and the captures intact until the handler
+// returns.
+typedef std::function<void(const TopicMatch& match, const char* payload, size_t length)> TopicHandler;
+
+// Copies a message out of the client's receive buffer into 'buffer' as
+// topic, NUL, payload, so handlers keep their views while the client builds
+// outgoing packets in its own buffer. Returns the payload copy, or nullptr
+// if the message does not fit.
+inline char* copyInboundMessage(char* buffer, size_t size, const char* topic, const uint8_t* payload, size_t length) {
+    size_t topicLength = strlen(topic);
+    if (topicLength + 1 + length > size) {
+        return nullptr;
+    }
+    memcpy(buffer, topic, topicLength + 1);
+    char* payloadCopy = buffer + topicLength + 1;
+    memcpy(payloadCopy, payload, length);
+    return payloadCopy;
+}
+
+// Dispatches MQTT topics to handlers registered by pattern.
+//
+// Patterns are compiled level by level into a trie. A level is a literal,
+// '+' (any one level), '#' (the rest of the topic, last level only; as in
+// MQTT it also matches the parent level itself) or a typed capture '{name}'
+// matching an unsigned decimal number. Dispatch walks the topic bytes once,
+// checking literal children before captures and wildcards, and only backs
+// up when a literal branch dead-ends. Nodes and labels live in fixed arrays
+// and dispatch does not allocate.
+class TopicRouter {
+public:
+    static const uint8_t MAX_NODES = 64;
+    static const uint8_t MAX_ROUTES = 32;
+    static const uint16_t LABEL_BYTES = 512;
+    
+    TopicRouter();
+    
+    // False if the pattern is malformed, already registered or does not fit
+    bool on(const char* pattern, TopicHandler handler);
+    
+    // Run the handler for 'topic'; false when no pattern matches
+    bool dispatch(const char* topic, const char* payload, size_t length) const;
+    
+    // Matching only, for callers that dispatch themselves
+    int8_t match(const char* topic, TopicMatch& result) const;
+
+private:
+    enum class NodeKind : uint8_t {
+        LITERAL,
+        NUMBER,     // {name}
+        ANY_LEVEL,  // +
+        ANY_REST    // #
+    };
+    
+    static const uint8_t NONE = 0xFF;
+    
+    struct Node {
+        NodeKind kind;
+        uint8_t labelLength;
+        uint16_t label;             // Offset into labels (literals)
+        uint8_t firstChild;
+        uint8_t nextSibling;
+        int8_t route;               // Index into handlers, -1 for none
+    };
+    
+    Node nodes[MAX_NODES];
+    uint8_t nodeCount;
+    char labels[LABEL_BYTES];
+    uint16_t labelTop;
+    TopicHandler handlers[MAX_ROUTES];
+    uint8_t routeCount;
+    
+    uint8_t findOrAddChild(uint8_t parent, NodeKind kind, const char* label, size_t length);
+    bool matchLevel(uint8_t node, const char* level, TopicMatch& result, int8_t& route) const;
+};
+
+#endif // TOPIC_ROUTER_H
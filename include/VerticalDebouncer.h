@@ -0,0 +1,51 @@
+#ifndef VERTICAL_DEBOUNCER_H
+#define VERTICAL_DEBOUNCER_H
+
+#include <cstdint>
+
+// Debouncer for up to 64 digital inputs at once, using a 2-bit vertical
+// counter per pin (bit n of every word belongs to GPIO n).
+//
+// Each sample costs a handful of 64-bit logic operations no matter how many
+// pins are bouncing. A pin's debounced level only flips after it has
+// disagreed with the current level for SAMPLES consecutive samples, and any
+// agreeing sample in between resets its counter. Unlike a time-since-last-edge
+// filter, the final settled level is never lost.
+class VerticalDebouncer {
+public:
+    static const uint8_t SAMPLES = 4;
+    
+    VerticalDebouncer() : state(0), count0(0), count1(0) {}
+    
+    // Force the debounced level of the pins in 'mask' (e.g. when a pin is
+    // first configured) and clear their counters
+    void seed(uint64_t mask, uint64_t levels) {
+        state = (state & ~mask) | (levels & mask);
+        count0 &= ~mask;
+        count1 &= ~mask;
+    }
+    
+    // Feed one raw sample of every input. Returns the pins whose debounced
+    // level changed with this sample.
+    uint64_t sample(uint64_t raw) {
+        uint64_t delta = raw ^ state;
+        
+        // Increment the counter of every differing pin, reset the others
+        count1 = (count1 ^ count0) & delta;
+        count0 = ~count0 & delta;
+        
+        // Counters that wrapped back to zero have seen SAMPLES differing samples
+        uint64_t toggled = delta & ~(count0 | count1);
+        state ^= toggled;
+        return toggled;
+    }
+    
+    uint64_t stable() const { return state; }
+
+private:
+    uint64_t state;     // Debounced levels
+    uint64_t count0;    // Counter bit 0 per pin
+    uint64_t count1;    // Counter bit 1 per pin
+};
+
+#endif // VERTICAL_DEBOUNCER_H
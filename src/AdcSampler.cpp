@@ -0,0 +1,258 @@
+#include "AdcSampler.h"
+
+#if ADC_SAMPLER_DMA
+// Result layout and conversion mode per target (see the IDF adc_dma example)
+#if CONFIG_IDF_TARGET_ESP32
+#define ADC_SAMPLER_RESULT_BYTES    2
+#define ADC_SAMPLER_CONV_LIMIT      true        // Required on ESP32
+#define ADC_SAMPLER_CONV_MODE       ADC_CONV_SINGLE_UNIT_1
+#define ADC_SAMPLER_FORMAT          ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#elif CONFIG_IDF_TARGET_ESP32S2
+#define ADC_SAMPLER_RESULT_BYTES    2
+#define ADC_SAMPLER_CONV_LIMIT      false
+#define ADC_SAMPLER_CONV_MODE       ADC_CONV_SINGLE_UNIT_1
+#define ADC_SAMPLER_FORMAT          ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#elif CONFIG_IDF_TARGET_ESP32C3
+#define ADC_SAMPLER_RESULT_BYTES    4
+#define ADC_SAMPLER_CONV_LIMIT      false
+#define ADC_SAMPLER_CONV_MODE       ADC_CONV_ALTER_UNIT     // Only mode on C3
+#define ADC_SAMPLER_FORMAT          ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#else
+#define ADC_SAMPLER_RESULT_BYTES    4
+#define ADC_SAMPLER_CONV_LIMIT      false
+#define ADC_SAMPLER_CONV_MODE       ADC_CONV_SINGLE_UNIT_1
+#define ADC_SAMPLER_FORMAT          ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#endif
+#endif
+
+AdcSampler::AdcSampler()
+    : requestedMask(0), runningMask(0), driverFailed(false), taskHandle(nullptr) {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        channels[i].active = false;
+        channels[i].pin = 0;
+    }
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+AdcSampler::~AdcSampler() {
+    if (taskHandle != nullptr) {
+        vTaskDelete(taskHandle);
+    }
+    stopDriver();
+}
+
+bool AdcSampler::attach(uint8_t pin, const AnalogFilterConfig& filter) {
+#if ADC_SAMPLER_DMA
+    int channel = channelForPin(pin);
+    if (channel < 0 || driverFailed) {
+        return false;
+    }
+    
+    portENTER_CRITICAL(&lock);
+    channels[channel].pin = pin;
+    channels[channel].filter.configure(filter);
+    channels[channel].active = true;
+    requestedMask |= (1UL << channel);
+    portEXIT_CRITICAL(&lock);
+    
+    if (taskHandle == nullptr) {
+        BaseType_t result = xTaskCreate(
+            taskFunction,
+            "ADCSampler",
+            3072,              // Stack size (frame buffer is a member)
+            this,              // Parameter (this pointer)
+            4,                 // Priority (below the IO worker)
+            &taskHandle
+        );
+        
+        if (result != pdPASS) {
+            Serial.println("ERROR: Failed to create ADC sampler task");
+            taskHandle = nullptr;
+            detach(pin);
+            return false;
+        }
+    } else {
+        xTaskNotifyGive(taskHandle);
+    }
+    return true;
+#else
+    (void)pin;
+    (void)filter;
+    return false;
+#endif
+}
+
+void AdcSampler::detach(uint8_t pin) {
+    int channel = channelForPin(pin);
+    if (channel < 0) {
+        return;
+    }
+    
+    portENTER_CRITICAL(&lock);
+    channels[channel].active = false;
+    requestedMask &= ~(1UL << channel);
+    portEXIT_CRITICAL(&lock);
+    
+    if (taskHandle != nullptr) {
+        xTaskNotifyGive(taskHandle);
+    }
+}
+
+bool AdcSampler::owns(uint8_t pin) {
+    int channel = channelForPin(pin);
+    if (channel < 0 || driverFailed) {
+        return false;
+    }
+    return channels[channel].active && channels[channel].pin == pin;
+}
+
+bool AdcSampler::read(uint8_t pin, uint16_t& value) {
+    int channel = channelForPin(pin);
+    if (channel < 0) {
+        return false;
+    }
+    
+    bool ready;
+    portENTER_CRITICAL(&lock);
+    ready = channels[channel].active && channels[channel].filter.ready();
+    value = channels[channel].filter.value();
+    portEXIT_CRITICAL(&lock);
+    return ready;
+}
+
+int AdcSampler::channelForPin(uint8_t pin) {
+    // Arduino numbers ADC1 channels from 0 and ADC2 channels from
+    // SOC_ADC_MAX_CHANNEL_NUM, so only ADC1 falls inside the table
+    int8_t channel = digitalPinToAnalogChannel(pin);
+    if (channel < 0 || channel >= MAX_CHANNELS) {
+        return -1;
+    }
+    return channel;
+}
+
+void AdcSampler::taskFunction(void* parameter) {
+    static_cast<AdcSampler*>(parameter)->run();
+}
+
+void AdcSampler::run() {
+    while (true) {
+        uint32_t wanted;
+        portENTER_CRITICAL(&lock);
+        wanted = requestedMask;
+        portEXIT_CRITICAL(&lock);
+        
+        // The channel list is fixed while the driver runs, so any change
+        // restarts it with the new set
+        if (wanted != runningMask && !driverFailed) {
+            stopDriver();
+            if (wanted != 0 && !startDriver(wanted)) {
+                Serial.println("ERROR: Failed to start ADC continuous mode, falling back to analogRead");
+                driverFailed = true;
+                wanted = 0;
+            }
+            runningMask = wanted;
+        }
+        
+        if (runningMask == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+#if ADC_SAMPLER_DMA
+        uint32_t length = 0;
+        esp_err_t err = adc_digi_read_bytes(frame, FRAME_BYTES, &length, READ_TIMEOUT_MS);
+        
+        // INVALID_STATE means the driver pool overflowed; what was read is
+        // still valid, only older conversions were lost
+        if (err == ESP_OK || err == ESP_ERR_INVALID_STATE) {
+            consume(frame, length);
+        }
+#endif
+
+        // Pick up attach/detach requests without blocking
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+}
+
+bool AdcSampler::startDriver(uint32_t mask) {
+#if ADC_SAMPLER_DMA
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = FRAME_BYTES * 16;
+    init.conv_num_each_intr = FRAME_BYTES;
+    init.adc1_chan_mask = mask;
+    init.adc2_chan_mask = 0;
+    
+    if (adc_digi_initialize(&init) != ESP_OK) {
+        return false;
+    }
+    
+    adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX] = {};
+    uint32_t patternCount = 0;
+    for (uint8_t channel = 0; channel < MAX_CHANNELS && patternCount < SOC_ADC_PATT_LEN_MAX; channel++) {
+        if (!(mask & (1UL << channel))) {
+            continue;
+        }
+        pattern[patternCount].atten = ADC_ATTEN_DB_11;
+        pattern[patternCount].channel = channel;
+        pattern[patternCount].unit = 0;    // ADC1
+        pattern[patternCount].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        patternCount++;
+    }
+    
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = ADC_SAMPLER_CONV_LIMIT;
+    config.conv_limit_num = 250;
+    config.pattern_num = patternCount;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = SAMPLE_RATE_HZ;
+    config.conv_mode = ADC_SAMPLER_CONV_MODE;
+    config.format = ADC_SAMPLER_FORMAT;
+    
+    if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+        adc_digi_deinitialize();
+        return false;
+    }
+    
+    Serial.println("ADC continuous sampling on " + String(patternCount) + " channel(s)");
+    return true;
+#else
+    (void)mask;
+    return false;
+#endif
+}
+
+void AdcSampler::stopDriver() {
+#if ADC_SAMPLER_DMA
+    if (runningMask != 0) {
+        adc_digi_stop();
+        adc_digi_deinitialize();
+        runningMask = 0;
+    }
+#endif
+}
+
+void AdcSampler::consume(const uint8_t* data, uint32_t length) {
+#if ADC_SAMPLER_DMA
+    portENTER_CRITICAL(&lock);
+    for (uint32_t i = 0; i + ADC_SAMPLER_RESULT_BYTES <= length; i += ADC_SAMPLER_RESULT_BYTES) {
+        const adc_digi_output_data_t* result = reinterpret_cast<const adc_digi_output_data_t*>(&data[i]);
+#if CONFIG_IDF_TARGET_ESP32
+        uint8_t channel = result->type1.channel;
+        uint16_t value = result->type1.data;
+#else
+        if (result->type2.unit != 0) {
+            continue;   // ADC2 conversion
+        }
+        uint8_t channel = result->type2.channel;
+        uint16_t value = result->type2.data;
+#endif
+        if (channel < MAX_CHANNELS && channels[channel].active) {
+            channels[channel].filter.push(value);
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+#else
+    (void)data;
+    (void)length;
+#endif
+}
@@ -1,18 +1,45 @@
 #include "InputManager.h"
 #include "MQTTManager.h"
+#include "GpioPort.h"
 
 // Static member initialization
-std::map<uint8_t, InputManager*> InputManager::isrHandlers;
+InputManager* InputManager::isrHandlers[InputManager::MAX_PINS] = {};
 
 InputManager::InputManager() 
-    : mqttManager(nullptr), eventQueue(nullptr), workerTaskHandle(nullptr) {
+    : mqttManager(nullptr), excludedMask(0), eventQueue(nullptr), workerTaskHandle(nullptr),
+      pinTable(relaxWriter), nextGeneration(1), openBursts(0),
+      batchCount(0), batchOpenedUs(0), batchEnabled(false), batchPerPin(true),
+      batchWindowMs(100), batchMax(16), pendingSchedules(0),
+      snapshotEnabled(false), snapshotIntervalMs(0),
+      debouncedMask(0), debounceTickMs(0), pinRecords(preferences),
+      suppressedPublishes(0), rules(relaxWriter), ruleFires(0) {
+    memset(runtime, 0, sizeof(runtime));
+    memset(requestedCounters, 0, sizeof(requestedCounters));
+    memset(bursts, 0, sizeof(bursts));
+    batchLock = portMUX_INITIALIZER_UNLOCKED;
+    scheduleLock = portMUX_INITIALIZER_UNLOCKED;
+    historyLock = portMUX_INITIALIZER_UNLOCKED;
+    for (uint8_t pin = 0; pin < MAX_PINS; pin++) {
+        historyLastValue[pin] = -1;
+    }
+    historyQuery.active = false;
+    configRequested = false;
 }
 
 InputManager::~InputManager() {
     // Cleanup interrupts
-    for (auto& pair : configuredPins) {
-        if (pair.second.mode == PinMode::INTERRUPT_MODE) {
-            detachPinInterrupt(pair.first);
+    const PinTable& table = pinTable.current();
+    uint64_t pending = table.configuredMask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        if (table.pins[pin].mode == PinMode::INTERRUPT_MODE) {
+            detachPinInterrupt(pin);
+        } else if (table.pins[pin].mode == PinMode::COUNTER_MODE) {
+            counters.detach(pin);
+        } else if (table.pins[pin].mode == PinMode::ANALOG_MODE) {
+            analogSampler.detach(pin);
         }
     }
     
@@ -29,13 +56,29 @@ InputManager::~InputManager() {
 
 void InputManager::begin(MQTTManager* mqtt) {
     mqttManager = mqtt;
+    if (mqttManager != nullptr) {
+        registerCommands();
+    }
     
     // Initialize preferences
     preferences.begin("io", false);
     
+    Serial.println("IO board profile: " + String(BOARD_PROFILE.name));
+    
     // Load exclude list
     loadExcludeList();
     
+    // Load batch publishing and snapshot settings
+    loadBatchConfig();
+    loadSnapshotConfig();
+    
+    // Output sequencer reports finished pulses/waveforms through the worker
+    if (sequencer.begin()) {
+        sequencer.setDoneCallback([this](uint64_t pinMask, uint8_t level) {
+            this->onSequenceDone(pinMask, level);
+        });
+    }
+    
     // Create event queue
     eventQueue = xQueueCreate(QUEUE_SIZE, sizeof(IOEvent));
     if (eventQueue == nullptr) {
@@ -47,7 +90,7 @@ void InputManager::begin(MQTTManager* mqtt) {
     BaseType_t result = xTaskCreate(
         workerTaskFunction,
         "IOWorker",
-        4096,              // Stack size
+        6144,              // Stack size (batch flush builds its JSON on the stack)
         this,              // Parameter (this pointer)
         5,                 // Priority
         &workerTaskHandle
@@ -58,158 +101,221 @@ void InputManager::begin(MQTTManager* mqtt) {
         return;
     }
     
-    // Load and apply saved configurations
+    // Load and apply saved configurations; rules need their pins in place
     loadConfig();
+    loadRules();
+    requestReportSchedule(SNAPSHOT_SCHEDULE_ID);
     
     Serial.println("InputManager initialized");
 }
 
-void InputManager::loop() {
-    // Check periodic reporting for configured pins
-    unsigned long now = millis();
+void InputManager::registerCommands() {
+    MQTTManager* mqtt = mqttManager;
     
-    for (auto& pair : configuredPins) {
-        PinConfig& config = pair.second;
+    mqtt->on("cmd/io/config", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<512> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
         
-        // Skip if no report topic or no interval
-        if (config.reportTopic.length() == 0 || config.reportIntervalMs == 0) {
-            continue;
+        if (!error) {
+            if (configurePin(doc)) {
+                mqtt->publishStatus("io_config_updated");
+                Serial.println("IO configuration updated via MQTT");
+            } else {
+                mqtt->publishStatus("io_config_failed");
+                Serial.println("IO configuration failed");
+            }
         }
+    });
+    
+    // Dump the IO configuration to {base}/io/config
+    mqtt->on("cmd/io/config/get", [this](const TopicMatch&, const char*, size_t) {
+        configRequested = true;
+    });
+    
+    mqtt->on("cmd/io/exclude", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<512> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
         
-        // Check if it's time to report
-        if (now - config.lastReportTime >= config.reportIntervalMs) {
-            config.lastReportTime = now;
+        if (!error) {
+            std::vector<uint8_t> pins;
+            std::vector<std::pair<uint8_t, uint8_t>> ranges;
+            bool persist = doc["persist"] | false;
             
-            // Read current value
-            int value;
-            if (config.mode == PinMode::ANALOG_MODE) {
-                value = analogRead(config.pin);
-            } else {
-                value = digitalRead(config.pin);
+            JsonArray pinsArray = doc["pins"];
+            for (JsonVariant pin : pinsArray) {
+                pins.push_back(pin.as<uint8_t>());
+            }
+            
+            JsonArray rangesArray = doc["ranges"];
+            for (JsonVariant rangeVariant : rangesArray) {
+                JsonObject rangeObj = rangeVariant.as<JsonObject>();
+                uint8_t from = rangeObj["from"];
+                uint8_t to = rangeObj["to"];
+                ranges.push_back(std::make_pair(from, to));
             }
             
-            // Queue event for processing
-            IOEvent event;
-            event.pin = config.pin;
-            event.type = (config.mode == PinMode::ANALOG_MODE) ? EventType::ANALOG_READ : EventType::DIGITAL;
-            event.value = value;
-            event.timestamp = now;
-            queueEvent(event);
+            if (setExcludeList(pins, ranges, persist)) {
+                mqtt->publishStatus("io_exclude_updated");
+                Serial.println("IO exclude list updated via MQTT");
+            }
         }
-    }
-}
-
-bool InputManager::configurePin(const JsonDocument& config) {
-    // Extract and validate pin number
-    if (!config.containsKey("pin")) {
-        Serial.println("ERROR: Pin number not specified");
-        return false;
-    }
+    });
     
-    uint8_t pin = config["pin"];
+    mqtt->on("cmd/io/batch", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<128> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        if (!error) {
+            mqtt->publishStatus(setBatchConfig(doc) ? "io_batch_updated" : "io_batch_failed");
+        }
+    });
     
-    if (!validatePin(pin)) {
-        Serial.println("ERROR: Pin " + String(pin) + " is excluded or reserved");
-        return false;
-    }
+    mqtt->on("cmd/io/waveform", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<1024> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        if (!error) {
+            mqtt->publishStatus(runWaveform(doc) ? "io_waveform_success" : "io_waveform_failed");
+        }
+    });
     
-    // Parse configuration
-    PinConfig pinConfig;
-    pinConfig.pin = pin;
+    // Atomic multi-pin output write
+    mqtt->on("cmd/io/write", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<512> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        if (!error) {
+            mqtt->publishStatus(writeOutputs(doc) ? "io_write_success" : "io_write_failed");
+        }
+    });
     
-    // Parse mode
-    String modeStr = config["mode"] | "input";
-    if (modeStr == "output") {
-        pinConfig.mode = PinMode::OUTPUT_MODE;
-    } else if (modeStr == "input") {
-        pinConfig.mode = PinMode::INPUT_MODE;
-    } else if (modeStr == "input_pullup") {
-        pinConfig.mode = PinMode::INPUT_PULLUP_MODE;
-    } else if (modeStr == "analog") {
-        pinConfig.mode = PinMode::ANALOG_MODE;
-    } else if (modeStr == "interrupt") {
-        pinConfig.mode = PinMode::INTERRUPT_MODE;
-    } else {
-        Serial.println("ERROR: Invalid mode: " + modeStr);
-        return false;
-    }
+    // Empty payload publishes a snapshot right away
+    mqtt->on("cmd/io/snapshot", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<128> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        if (length == 0 || error) {
+            publishSnapshot();
+        } else if (setSnapshotConfig(doc)) {
+            mqtt->publishStatus("io_snapshot_updated");
+        }
+    });
     
-    // Parse interrupt edge
-    String edgeStr = config["edge"] | "change";
-    if (edgeStr == "rising") {
-        pinConfig.edge = InterruptEdge::RISING_EDGE;
-    } else if (edgeStr == "falling") {
-        pinConfig.edge = InterruptEdge::FALLING_EDGE;
-    } else if (edgeStr == "change") {
-        pinConfig.edge = InterruptEdge::CHANGE_EDGE;
-    } else {
-        pinConfig.edge = InterruptEdge::NONE;
-    }
+    // Replaces the whole rule set, [] clears it
+    mqtt->on("cmd/io/rules", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<2048> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        if (!error) {
+            mqtt->publishStatus(setRules(doc) ? "io_rules_updated" : "io_rules_failed");
+        }
+    });
     
-    // Parse other parameters
-    pinConfig.debounceMs = config["debounce"] | 50;
-    pinConfig.pulseWidthMs = config["pulse"] | 100;
-    pinConfig.reportIntervalMs = config["interval"] | 0;
-    pinConfig.reportTopic = config["report_topic"] | "";
-    pinConfig.persist = config["persist"] | false;
-    pinConfig.retain = config["retain"] | false;
-    pinConfig.lastReportTime = 0;
-    pinConfig.lastValue = -1;
+    // Empty payload streams everything recorded
+    mqtt->on("cmd/io/history", [this, mqtt](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<192> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        if (length == 0 || !error) {
+            if (!queryHistory(doc)) {
+                mqtt->publishStatus("io_history_failed");
+            }
+        }
+    });
     
-    // Validate report_topic is required
-    if (pinConfig.reportTopic.length() == 0) {
-        Serial.println("ERROR: report_topic is required");
+    // Payload is a plain action ("set") or {"action": ..., "pulse": ms}
+    mqtt->on("cmd/io/{pin}/trigger", [this, mqtt](const TopicMatch& match, const char* payload, size_t length) {
+        uint32_t pin = match.number(0);
+        
+        StaticJsonDocument<128> doc;
+        DeserializationError error = mqtt->decode(doc, payload, length);
+        
+        String action;
+        uint16_t pulseWidth = 100;
+        
+        if (!error && doc.is<JsonObject>()) {
+            action = doc["action"] | "set";
+            pulseWidth = doc["pulse"] | 100;
+        } else {
+            // Plain text action; the payload is not NUL-terminated
+            char text[16];
+            size_t textLength = std::min(length, sizeof(text) - 1);
+            memcpy(text, payload, textLength);
+            text[textLength] = '\0';
+            action = text;
+        }
+        
+        if (pin < MAX_PINS && triggerPin(pin, action, pulseWidth)) {
+            mqtt->publishStatus("io_trigger_success");
+            Serial.println("IO trigger executed on pin " + String(pin));
+        } else {
+            mqtt->publishStatus("io_trigger_failed");
+            Serial.println("IO trigger failed on pin " + String(pin));
+        }
+    });
+}
+
+void InputManager::loop() {
+    // Periodic reporting runs on the worker task's deadline scheduler; only
+    // history queries are streamed from here, one chunk per call
+    streamHistory();
+    
+    // The configuration can be too large for a queue slot, and streaming it
+    // must wait until everything older has gone out
+    if (configRequested && mqttManager != nullptr && !mqttManager->hasBacklog()) {
+        configRequested = false;
+        publishConfig();
+    }
+}
+
+bool InputManager::configurePin(const JsonDocument& config) {
+    PinConfig pinConfig;
+    if (!parsePinConfig(config.as<JsonVariantConst>(), pinConfig)) {
         return false;
     }
     
-    // Remove old configuration if exists
-    if (configuredPins.find(pin) != configuredPins.end()) {
-        removePin(pin);
+    if (pinConfig.persist && pinConfig.reportTopic.length() >= PIN_RECORD_TOPIC_SIZE) {
+        Serial.println("ERROR: report_topic too long to persist (max " +
+                       String(PIN_RECORD_TOPIC_SIZE - 1) + " characters)");
+        return false;
     }
     
-    // Configure hardware
-    configurePinHardware(pinConfig);
-    
-    // Store configuration
-    configuredPins[pin] = pinConfig;
+    if (!applyPinConfig(pinConfig)) {
+        // A reconfiguration that failed after releasing the old setup leaves
+        // the pin unconfigured; its old record would bring it back at boot
+        if (pinTable.current().find(pinConfig.pin) == nullptr) {
+            erasePinRecord(pinConfig.pin);
+        }
+        return false;
+    }
     
-    // Save to NVS if persist is true
+    // Only this pin's record is written (or dropped if it no longer persists)
     if (pinConfig.persist) {
-        saveConfig();
+        savePinRecord(pinConfig);
+    } else {
+        erasePinRecord(pinConfig.pin);
     }
     
-    Serial.println("Pin " + String(pin) + " configured as " + modeStr);
-    
-    // Publish initial state
-    if (pinConfig.mode != PinMode::OUTPUT_MODE) {
-        int value;
-        if (pinConfig.mode == PinMode::ANALOG_MODE) {
-            value = analogRead(pin);
-        } else {
-            value = digitalRead(pin);
-        }
-        publishPinState(pin, value);
-    }
+    Serial.println("Pin " + String(pinConfig.pin) + " configured as " + modeName(pinConfig.mode));
     
+    publishInitialState(pinConfig);
     return true;
 }
 
 bool InputManager::removePin(uint8_t pin) {
-    auto it = configuredPins.find(pin);
-    if (it == configuredPins.end()) {
+    if (pinTable.current().find(pin) == nullptr) {
         return false;
     }
     
-    // Detach interrupt if needed
-    if (it->second.mode == PinMode::INTERRUPT_MODE) {
-        detachPinInterrupt(pin);
-    }
+    PinMode oldMode = pinTable.current().pins[pin].mode;
+    PinTable& table = pinTable.edit();
+    releasePin(table, pin);
+    pinTable.publish();
     
-    // Remove from map
-    configuredPins.erase(it);
+    requestScheduleUpdates(pin, oldMode, PinMode::NONE);
     
     // Update NVS
-    saveConfig();
+    erasePinRecord(pin);
     
     Serial.println("Pin " + String(pin) + " removed");
     return true;
@@ -220,6 +326,7 @@ bool InputManager::setExcludeList(const std::vector<uint8_t>& pins,
                                   bool persist) {
     excludedPins = pins;
     excludedRanges = ranges;
+    updateExcludedMask();
     
     if (persist) {
         saveExcludeList(pins, ranges, true);
@@ -236,14 +343,47 @@ void InputManager::getExcludeList(std::vector<uint8_t>& pins,
     ranges = excludedRanges;
 }
 
+bool InputManager::setBatchConfig(const JsonDocument& config) {
+    bool enabled = config["enabled"] | batchEnabled;
+    uint16_t window = config["window"] | batchWindowMs;
+    uint8_t maxCount = config["max"] | batchMax;
+    bool perPin = config["per_pin"] | batchPerPin;
+    bool persist = config["persist"] | false;
+    
+    if (window == 0 || maxCount == 0 || maxCount > BATCH_CAPACITY) {
+        Serial.println("ERROR: Invalid batch settings (window > 0, 1 <= max <= " + 
+                       String(BATCH_CAPACITY) + ")");
+        return false;
+    }
+    
+    // Push out anything collected under the old settings
+    flushBatch();
+    
+    portENTER_CRITICAL(&batchLock);
+    batchEnabled = enabled;
+    batchWindowMs = window;
+    batchMax = maxCount;
+    batchPerPin = perPin;
+    portEXIT_CRITICAL(&batchLock);
+    
+    if (persist) {
+        saveBatchConfig();
+    }
+    
+    Serial.println("Batch publishing " + String(enabled ? "enabled" : "disabled") +
+                   " (window " + String(window) + " ms, max " + String(maxCount) + ")");
+    return true;
+}
+
 bool InputManager::triggerPin(uint8_t pin, const String& action, uint16_t pulseWidthMs) {
-    auto it = configuredPins.find(pin);
-    if (it == configuredPins.end()) {
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    const PinState* state = table->find(pin);
+    if (state == nullptr) {
         Serial.println("ERROR: Pin " + String(pin) + " not configured");
         return false;
     }
     
-    if (it->second.mode != PinMode::OUTPUT_MODE) {
+    if (state->mode != PinMode::OUTPUT_MODE) {
         Serial.println("ERROR: Pin " + String(pin) + " not configured as output");
         return false;
     }
@@ -256,7 +396,7 @@ bool InputManager::triggerPin(uint8_t pin, const String& action, uint16_t pulseW
     } else if (action == "pulse") {
         type = TriggerType::PULSE;
         if (pulseWidthMs == 0) {
-            pulseWidthMs = it->second.pulseWidthMs;
+            pulseWidthMs = table->settings[pin].pulseWidthMs;
         }
     } else if (action == "toggle") {
         type = TriggerType::TOGGLE;
@@ -265,239 +405,1065 @@ bool InputManager::triggerPin(uint8_t pin, const String& action, uint16_t pulseW
         return false;
     }
     
-    applyTrigger(pin, type, pulseWidthMs);
-    return true;
+    return applyTrigger(*table, pin, type, pulseWidthMs);
 }
 
-void InputManager::reportAllPins() {
-    for (auto& pair : configuredPins) {
-        PinConfig& config = pair.second;
-        
-        if (config.reportTopic.length() == 0) {
-            continue;
-        }
-        
-        int value;
-        if (config.mode == PinMode::ANALOG_MODE) {
-            value = analogRead(config.pin);
-        } else {
-            value = digitalRead(config.pin);
+bool InputManager::runWaveform(const JsonDocument& config) {
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    uint64_t pinMask = 0;
+    JsonArrayConst pinsArray = config["pins"];
+    for (JsonVariantConst pinVariant : pinsArray) {
+        uint8_t pin = pinVariant.as<uint8_t>();
+        const PinState* state = table->find(pin);
+        if (state == nullptr || state->mode != PinMode::OUTPUT_MODE) {
+            Serial.println("ERROR: Pin " + String(pin) + " not configured as output");
+            return false;
         }
-        
-        publishPinState(config.pin, value);
+        pinMask |= (1ULL << pin);
     }
-}
-
-String InputManager::getConfigJson() {
-    StaticJsonDocument<2048> doc;
-    JsonArray pinsArray = doc.createNestedArray("pins");
     
-    for (auto& pair : configuredPins) {
-        JsonObject pinObj = pinsArray.createNestedObject();
-        PinConfig& config = pair.second;
-        
-        pinObj["pin"] = config.pin;
+    if (pinMask == 0) {
+        Serial.println("ERROR: Waveform needs at least one pin");
+        return false;
+    }
+    
+    if (config["stop"] | false) {
+        sequencer.cancel(pinMask);
+        return true;
+    }
+    
+    // Steps are {"level": 0|1, "us": n} or {"level": 0|1, "ms": n}
+    WaveformStep steps[OutputSequencer::MAX_STEPS];
+    uint8_t stepCount = 0;
+    JsonArrayConst stepsArray = config["steps"];
+    for (JsonVariantConst stepVariant : stepsArray) {
+        if (stepCount >= OutputSequencer::MAX_STEPS) {
+            Serial.println("ERROR: Waveform has more than " + String(OutputSequencer::MAX_STEPS) + " steps");
+            return false;
+        }
         
-        String modeStr;
-        switch (config.mode) {
-            case PinMode::OUTPUT_MODE: modeStr = "output"; break;
-            case PinMode::INPUT_MODE: modeStr = "input"; break;
-            case PinMode::INPUT_PULLUP_MODE: modeStr = "input_pullup"; break;
-            case PinMode::ANALOG_MODE: modeStr = "analog"; break;
-            case PinMode::INTERRUPT_MODE: modeStr = "interrupt"; break;
-            default: modeStr = "none"; break;
+        JsonObjectConst stepObj = stepVariant.as<JsonObjectConst>();
+        uint32_t durationUs = stepObj["us"] | 0;
+        if (durationUs == 0) {
+            durationUs = (uint32_t)(stepObj["ms"] | 0) * 1000;
         }
-        pinObj["mode"] = modeStr;
+        int level = stepObj["level"] | 0;
         
-        pinObj["report_topic"] = config.reportTopic;
-        pinObj["interval"] = config.reportIntervalMs;
-    }
-    
-    String output;
-    serializeJson(doc, output);
-    return output;
-}
-
-// Private methods
-
-void InputManager::loadConfig() {
-    String configJson = preferences.getString("pins", "");
-    if (configJson.length() == 0) {
-        Serial.println("No saved pin configurations");
-        return;
+        steps[stepCount].level = level ? HIGH : LOW;
+        steps[stepCount].durationUs = durationUs;
+        stepCount++;
     }
     
-    StaticJsonDocument<2048> doc;
-    DeserializationError error = deserializeJson(doc, configJson);
+    uint32_t repeat = config["repeat"] | 1;
+    int idleLevel = config["idle"] | 0;
     
-    if (error) {
-        Serial.println("ERROR: Failed to parse saved config");
-        return;
+    if (!sequencer.start(pinMask, steps, stepCount, repeat, idleLevel ? HIGH : LOW)) {
+        Serial.println("ERROR: Failed to start waveform");
+        return false;
     }
     
-    JsonArray pinsArray = doc["pins"];
-    for (JsonVariant pinVariant : pinsArray) {
-        StaticJsonDocument<512> pinDoc;
-        JsonObject obj = pinVariant.as<JsonObject>();
-        pinDoc.set(obj);
-        configurePin(pinDoc);
+    // Report the starting level; the final level follows when the sequence ends
+    uint64_t pending = pinMask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        publishPinState(*table, pin, steps[0].level);
     }
     
-    Serial.println("Loaded " + String(configuredPins.size()) + " pin configurations");
+    return true;
 }
 
-void InputManager::saveConfig() {
-    StaticJsonDocument<2048> doc;
-    JsonArray pinsArray = doc.createNestedArray("pins");
-    
-    for (auto& pair : configuredPins) {
-        if (!pair.second.persist) {
-            continue;
-        }
-        
-        JsonObject pinObj = pinsArray.createNestedObject();
-        PinConfig& config = pair.second;
-        
-        pinObj["pin"] = config.pin;
-        
-        String modeStr;
-        switch (config.mode) {
-            case PinMode::OUTPUT_MODE: modeStr = "output"; break;
-            case PinMode::INPUT_MODE: modeStr = "input"; break;
-            case PinMode::INPUT_PULLUP_MODE: modeStr = "input_pullup"; break;
-            case PinMode::ANALOG_MODE: modeStr = "analog"; break;
-            case PinMode::INTERRUPT_MODE: modeStr = "interrupt"; break;
-            default: continue;
-        }
-        pinObj["mode"] = modeStr;
-        
-        String edgeStr;
-        switch (config.edge) {
-            case InterruptEdge::RISING_EDGE: edgeStr = "rising"; break;
-            case InterruptEdge::FALLING_EDGE: edgeStr = "falling"; break;
-            case InterruptEdge::CHANGE_EDGE: edgeStr = "change"; break;
-            default: edgeStr = "none"; break;
-        }
-        if (edgeStr != "none") {
-            pinObj["edge"] = edgeStr;
+bool InputManager::writeOutputs(const JsonDocument& config) {
+    // Either {"mask": m, "value": v} or {"pins": {"13": 1, "25": 0}}
+    uint64_t mask = 0;
+    uint64_t levels = 0;
+    
+    if (config.containsKey("mask")) {
+        mask = config["mask"].as<uint64_t>();
+        levels = config["value"].as<uint64_t>();
+    } else {
+        JsonObjectConst pinsObj = config["pins"];
+        for (JsonPairConst pair : pinsObj) {
+            int pin = atoi(pair.key().c_str());
+            if (pin < 0 || pin >= MAX_PINS) {
+                Serial.println("ERROR: Invalid pin " + String(pair.key().c_str()));
+                return false;
+            }
+            mask |= (1ULL << pin);
+            if (pair.value().as<int>()) {
+                levels |= (1ULL << pin);
+            }
         }
-        
-        pinObj["debounce"] = config.debounceMs;
-        pinObj["pulse"] = config.pulseWidthMs;
-        pinObj["interval"] = config.reportIntervalMs;
-        pinObj["report_topic"] = config.reportTopic;
-        pinObj["persist"] = config.persist;
-        pinObj["retain"] = config.retain;
     }
     
-    String output;
-    serializeJson(doc, output);
-    preferences.putString("pins", output);
-    
-    Serial.println("Configuration saved");
-}
-
-void InputManager::loadExcludeList() {
-    String excludeJson = preferences.getString("exclude", "");
-    if (excludeJson.length() == 0) {
-        Serial.println("No saved exclude list");
-        return;
+    if (mask == 0) {
+        Serial.println("ERROR: No output pins given");
+        return false;
     }
     
-    StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, excludeJson);
-    
-    if (error) {
-        Serial.println("ERROR: Failed to parse exclude list");
-        return;
+    // Every pin must be a configured output before anything is written
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    uint64_t pending = mask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        const PinState* state = table->find(pin);
+        if (state == nullptr || state->mode != PinMode::OUTPUT_MODE) {
+            Serial.println("ERROR: Pin " + String(pin) + " not configured as output");
+            return false;
+        }
     }
     
-    excludedPins.clear();
-    excludedRanges.clear();
+    sequencer.cancel(mask);
+    GpioPort::write(mask, levels);
+    int64_t now = esp_timer_get_time();
     
-    JsonArray pinsArray = doc["pins"];
-    for (JsonVariant pin : pinsArray) {
-        excludedPins.push_back(pin.as<uint8_t>());
+    // One combined report instead of one message per pin
+    StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(MAX_PINS)> doc;
+    doc["t"] = now;
+    JsonObject pinsObj = doc.createNestedObject("pins");
+    
+    char key[4];
+    pending = mask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        int level = (levels >> pin) & 0x1;
+        
+        snprintf(key, sizeof(key), "%u", pin);
+        pinsObj[key] = level;   // char* key is copied into the document
+        
+        recordHistory(pin, EventType::TRIGGER, level, now);
     }
     
-    JsonArray rangesArray = doc["ranges"];
-    for (JsonVariant rangeVariant : rangesArray) {
-        JsonObject rangeObj = rangeVariant.as<JsonObject>();
-        uint8_t from = rangeObj["from"];
-        uint8_t to = rangeObj["to"];
-        excludedRanges.push_back(std::make_pair(from, to));
+    if (mqttManager != nullptr) {
+        mqttManager->publishJson(mqttManager->topic(DeviceTopic::IO_OUTPUTS), doc, false);
     }
     
-    Serial.println("Loaded exclude list: " + String(excludedPins.size()) + 
-                   " pins, " + String(excludedRanges.size()) + " ranges");
+    return true;
 }
 
-void InputManager::saveExcludeList(const std::vector<uint8_t>& pins,
-                                   const std::vector<std::pair<uint8_t, uint8_t>>& ranges,
-                                   bool persist) {
-    StaticJsonDocument<512> doc;
+bool InputManager::setSnapshotConfig(const JsonDocument& config) {
+    bool enabled = config["enabled"] | snapshotEnabled;
+    uint32_t interval = config["interval"] | snapshotIntervalMs;
+    bool persist = config["persist"] | false;
     
-    JsonArray pinsArray = doc.createNestedArray("pins");
-    for (uint8_t pin : pins) {
-        pinsArray.add(pin);
-    }
+    snapshotEnabled = enabled;
+    snapshotIntervalMs = interval;
     
-    JsonArray rangesArray = doc.createNestedArray("ranges");
-    for (auto& range : ranges) {
-        JsonObject rangeObj = rangesArray.createNestedObject();
-        rangeObj["from"] = range.first;
-        rangeObj["to"] = range.second;
+    if (persist) {
+        saveSnapshotConfig();
     }
     
-    String output;
-    serializeJson(doc, output);
-    preferences.putString("exclude", output);
+    // Let the worker (re)arm the periodic snapshot
+    requestReportSchedule(SNAPSHOT_SCHEDULE_ID);
     
-    Serial.println("Exclude list saved");
+    Serial.println("Snapshot mode " + String(enabled ? "enabled" : "disabled") +
+                   " (interval " + String(interval) + " ms)");
+    return true;
 }
 
-bool InputManager::isPinExcluded(uint8_t pin) {
-    // Check individual pins
-    for (uint8_t excluded : excludedPins) {
-        if (pin == excluded) {
-            return true;
-        }
+bool InputManager::setRules(const JsonDocument& config) {
+    JsonArrayConst rulesArray = config["rules"];
+    if (rulesArray.isNull()) {
+        Serial.println("ERROR: Missing rules array");
+        return false;
     }
     
-    // Check ranges
-    for (auto& range : excludedRanges) {
-        if (pin >= range.first && pin <= range.second) {
-            return true;
-        }
+    if (!applyRules(rulesArray)) {
+        return false;
     }
     
-    return false;
-}
-
-bool InputManager::isPinReserved(uint8_t pin) {
-    for (uint8_t reserved : RESERVED_PINS) {
-        if (pin == reserved) {
-            return true;
+    bool persist = config["persist"] | false;
+    if (persist) {
+        if (rulesArray.size() == 0) {
+            preferences.remove("rules");
+        } else {
+            String output;
+            serializeJson(rulesArray, output);
+            preferences.putString("rules", output);
         }
+        Serial.println("Rules saved");
     }
-    return false;
+    
+    Serial.println("Loaded " + String(rulesArray.size()) + " IO rules");
+    return true;
 }
 
-bool InputManager::validatePin(uint8_t pin) {
-    if (isPinReserved(pin)) {
-        Serial.println("ERROR: Pin " + String(pin) + " is reserved");
+bool InputManager::queryHistory(const JsonDocument& query) {
+    int pin = query["pin"] | (int)HISTORY_ALL_PINS;
+    if (pin != HISTORY_ALL_PINS && (pin < 0 || pin >= MAX_PINS)) {
+        Serial.println("ERROR: Invalid pin " + String(pin));
         return false;
     }
     
-    if (isPinExcluded(pin)) {
-        Serial.println("ERROR: Pin " + String(pin) + " is excluded");
+    int64_t now = esp_timer_get_time();
+    int64_t fromUs = query["from"] | (int64_t)0;
+    int64_t toUs = query["to"] | now;
+    if (toUs < fromUs) {
+        Serial.println("ERROR: History range ends before it starts");
         return false;
     }
     
+    int chunkSize = query["chunk"] | (int)HISTORY_CHUNK_DEFAULT;
+    if (chunkSize < 1 || chunkSize > HISTORY_CHUNK_MAX) {
+        chunkSize = HISTORY_CHUNK_MAX;
+    }
+    
+    if (historyQuery.active) {
+        Serial.println("WARNING: History query " + historyQuery.id + " replaced");
+    }
+    
+    historyQuery.pin = pin;
+    historyQuery.fromUs = fromUs;
+    historyQuery.toUs = toUs;
+    historyQuery.chunk = 0;
+    historyQuery.chunkSize = chunkSize;
+    historyQuery.id = query["id"] | "";
+    
+    // Changes recorded after this point are not part of the answer. The
+    // answer is only complete if the ring still reaches back to 'from'.
+    IOEvent first;
+    portENTER_CRITICAL(&historyLock);
+    historyQuery.cursor = history.oldest();
+    historyQuery.end = history.next();
+    uint32_t cursor = historyQuery.cursor;
+    bool anyKept = history.collect(cursor, historyQuery.end, [](const IOEvent&) { return true; }, &first, 1, 1) > 0;
+    portEXIT_CRITICAL(&historyLock);
+    
+    historyQuery.complete = (historyQuery.cursor == 0) || (anyKept && first.timestamp <= fromUs);
+    historyQuery.active = true;
+    return true;
+}
+
+void InputManager::publishSnapshot() {
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    publishSnapshot(*table);
+}
+
+void InputManager::publishSnapshot(const PinTable& table) {
+    if (mqttManager == nullptr) {
+        return;
+    }
+    
+    // Both input banks are read back to back, so every bit comes from the
+    // same instant
+    uint64_t mask = table.digitalInputMask;
+    uint64_t levels = GpioPort::readInputs() & mask;
+    int64_t now = esp_timer_get_time();
+    
+    StaticJsonDocument<JSON_OBJECT_SIZE(3)> doc;
+    doc["t"] = now;
+    doc["mask"] = mask;
+    doc["bits"] = levels;
+    
+    mqttManager->publishJson(mqttManager->topic(DeviceTopic::IO_SNAPSHOT), doc, false);
+}
+
+void InputManager::reportAllPins() {
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    
+    // In snapshot mode all digital inputs go out as one bitmap
+    if (snapshotEnabled && table->digitalInputMask != 0) {
+        publishSnapshot(*table);
+    }
+    
+    uint64_t pending = table->configuredMask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        const PinState& state = table->pins[pin];
+        
+        if (table->topics.length(state.topic) == 0) {
+            continue;
+        }
+        
+        if (snapshotEnabled && isDigitalInput(state.mode)) {
+            continue;
+        }
+        
+        if (state.mode == PinMode::COUNTER_MODE) {
+            CounterBaseline& baseline = requestedCounters[pin];
+            if (baseline.generation != state.generation) {
+                baseline.total = 0;
+                baseline.generation = state.generation;
+            }
+            publishCounter(*table, pin, esp_timer_get_time(), baseline.total);
+            continue;
+        }
+        
+        int value;
+        if (state.mode == PinMode::ANALOG_MODE) {
+            value = readAnalog(pin);
+            if (value < 0) {
+                continue;
+            }
+        } else {
+            value = digitalRead(pin);
+        }
+        
+        publishPinState(*table, pin, value);
+    }
+}
+
+uint32_t InputManager::getDroppedEventCount() const {
+    return isrEvents.droppedCount();
+}
+
+uint32_t InputManager::getSuppressedPublishCount() const {
+    return suppressedPublishes;
+}
+
+uint32_t InputManager::getRuleFireCount() const {
+    return ruleFires;
+}
+
+String InputManager::getConfigJson() {
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    ConfigSnapshot<RuleProgram>::Reader program(rules);
+    StaticJsonDocument<2048> doc;
+    buildConfigJson(*table, *program, doc);
+    
+    String output;
+    serializeJson(doc, output);
+    return output;
+}
+
+void InputManager::publishConfig() {
+    if (mqttManager == nullptr) {
+        return;
+    }
+    
+    // Topics in the document point into the table, so it stays pinned until
+    // the message is written
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    ConfigSnapshot<RuleProgram>::Reader program(rules);
+    StaticJsonDocument<2048> doc;
+    buildConfigJson(*table, *program, doc);
+    
+    if (!mqttManager->publishJson(mqttManager->topic(DeviceTopic::IO_CONFIG), doc, false)) {
+        Serial.println("WARNING: IO configuration could not be published");
+    }
+}
+
+// Private methods
+
+void InputManager::buildConfigJson(const PinTable& table, const RuleProgram& program, JsonDocument& doc) {
+    JsonArray pinsArray = doc.createNestedArray("pins");
+    
+    uint64_t pending = table.configuredMask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        JsonObject pinObj = pinsArray.createNestedObject();
+        const PinState& state = table.pins[pin];
+        
+        pinObj["pin"] = pin;
+        
+        pinObj["mode"] = modeName(state.mode);
+        
+        pinObj["report_topic"] = table.topics.get(state.topic);
+        pinObj["interval"] = state.reportIntervalMs;
+        
+        if (state.mode == PinMode::ANALOG_MODE) {
+            // Worker-owned counter; only valid for the current generation
+            const PinRuntime& pinRuntime = runtime[pin];
+            pinObj["suppressed"] = (pinRuntime.generation == state.generation) ? pinRuntime.suppressedCount : 0;
+        }
+    }
+    
+    doc["rules"] = program.ruleCount;
+}
+
+bool InputManager::parsePinConfig(JsonVariantConst config, PinConfig& pinConfig) {
+    // Extract and validate pin number
+    if (!config.containsKey("pin")) {
+        Serial.println("ERROR: Pin number not specified");
+        return false;
+    }
+    
+    uint8_t pin = config["pin"];
+    
+    if (!validatePin(pin)) {
+        Serial.println("ERROR: Pin " + String(pin) + " is excluded or reserved");
+        return false;
+    }
+    
+    pinConfig.pin = pin;
+    
+    // Parse mode
+    String modeStr = config["mode"] | "input";
+    if (modeStr == "output") {
+        pinConfig.mode = PinMode::OUTPUT_MODE;
+    } else if (modeStr == "input") {
+        pinConfig.mode = PinMode::INPUT_MODE;
+    } else if (modeStr == "input_pullup") {
+        pinConfig.mode = PinMode::INPUT_PULLUP_MODE;
+    } else if (modeStr == "analog") {
+        pinConfig.mode = PinMode::ANALOG_MODE;
+    } else if (modeStr == "interrupt") {
+        pinConfig.mode = PinMode::INTERRUPT_MODE;
+    } else if (modeStr == "counter") {
+        pinConfig.mode = PinMode::COUNTER_MODE;
+    } else {
+        Serial.println("ERROR: Invalid mode: " + modeStr);
+        return false;
+    }
+    
+    if (!validatePinMode(pin, pinConfig.mode)) {
+        return false;
+    }
+    
+    // Parse interrupt edge (counters count rising edges unless told otherwise)
+    String edgeStr = config["edge"] | (pinConfig.mode == PinMode::COUNTER_MODE ? "rising" : "change");
+    if (edgeStr == "rising") {
+        pinConfig.edge = InterruptEdge::RISING_EDGE;
+    } else if (edgeStr == "falling") {
+        pinConfig.edge = InterruptEdge::FALLING_EDGE;
+    } else if (edgeStr == "change") {
+        pinConfig.edge = InterruptEdge::CHANGE_EDGE;
+    } else {
+        pinConfig.edge = InterruptEdge::NONE;
+    }
+    
+    // Parse other parameters
+    pinConfig.debounceMs = config["debounce"] | 50;
+    pinConfig.pulseWidthMs = config["pulse"] | 100;
+    pinConfig.reportIntervalMs = config["interval"] | 0;
+    pinConfig.filter = AnalogFilter::defaults();
+    pinConfig.filter.oversample = config["oversample"] | pinConfig.filter.oversample;
+    pinConfig.filter.median = config["median"] | pinConfig.filter.median;
+    pinConfig.filter.average = config["average"] | pinConfig.filter.average;
+    pinConfig.filter.iirShift = config["iir"] | pinConfig.filter.iirShift;
+    pinConfig.deadband = config["deadband"] | 0;
+    pinConfig.deadbandPermille = (uint16_t)lroundf((float)(config["deadband_pct"] | 0.0f) * 10.0f);
+    pinConfig.heartbeatMs = config["heartbeat"] | 0;
+    pinConfig.reportTopic = config["report_topic"] | "";
+    pinConfig.persist = config["persist"] | false;
+    pinConfig.retain = config["retain"] | false;
+    
+    // Counters only ever report periodically
+    if (pinConfig.mode == PinMode::COUNTER_MODE && pinConfig.reportIntervalMs == 0) {
+        pinConfig.reportIntervalMs = 1000;
+    }
+    
+    // Validate report_topic is required
+    if (pinConfig.reportTopic.length() == 0) {
+        Serial.println("ERROR: report_topic is required");
+        return false;
+    }
+    
+    if (pinConfig.mode == PinMode::ANALOG_MODE && !AnalogFilter::isValid(pinConfig.filter)) {
+        Serial.println("ERROR: Invalid analog filter (oversample 1-64, median odd 1-7, average 1-16, iir 0-8)");
+        return false;
+    }
+    
+    return true;
+}
+
+bool InputManager::applyPinConfig(const PinConfig& pinConfig) {
+    uint8_t pin = pinConfig.pin;
+    
+    // All changes go into a private copy of the table; readers keep seeing
+    // the old one until it is published below
+    const PinState* old = pinTable.current().find(pin);
+    PinMode oldMode = (old != nullptr) ? old->mode : PinMode::NONE;
+    PinTable& table = pinTable.edit();
+    
+    // Intern the topic before releasing the old one, so a pin that keeps its
+    // topic shares the existing copy
+    uint16_t topic = table.topics.intern(pinConfig.reportTopic.c_str());
+    if (topic == table.topics.INVALID) {
+        Serial.println("ERROR: Topic pool full, cannot configure pin " + String(pin));
+        return false;
+    }
+    
+    // Remove old configuration if exists
+    if (old != nullptr) {
+        releasePin(table, pin);
+    }
+    
+    // Configure hardware
+    bool configured = configurePinHardware(pinConfig);
+    if (configured) {
+        PinState& state = table.pins[pin];
+        state.mode = pinConfig.mode;
+        state.edge = pinConfig.edge;
+        state.retain = pinConfig.retain;
+        state.persist = pinConfig.persist;
+        state.debounceMs = pinConfig.debounceMs;
+        state.topic = topic;
+        state.reportIntervalMs = pinConfig.reportIntervalMs;
+        state.deadband = pinConfig.deadband;
+        state.deadbandPermille = pinConfig.deadbandPermille;
+        state.heartbeatMs = pinConfig.heartbeatMs;
+        state.generation = nextGeneration++;
+        
+        table.settings[pin].pulseWidthMs = pinConfig.pulseWidthMs;
+        table.settings[pin].filter = pinConfig.filter;
+        
+        table.configuredMask |= (1ULL << pin);
+        if (isDigitalInput(pinConfig.mode)) {
+            table.digitalInputMask |= (1ULL << pin);
+        }
+        if (pinConfig.mode == PinMode::INPUT_MODE || pinConfig.mode == PinMode::INPUT_PULLUP_MODE) {
+            table.polledInputMask |= (1ULL << pin);
+        }
+    } else {
+        table.topics.release(topic);
+    }
+    
+    // Publish even on failure when the old configuration was released
+    if (configured || old != nullptr) {
+        pinTable.publish();
+    }
+    
+    requestScheduleUpdates(pin, oldMode, configured ? pinConfig.mode : PinMode::NONE);
+    return configured;
+}
+
+void InputManager::requestScheduleUpdates(uint8_t pin, PinMode oldMode, PinMode newMode) {
+    // The worker re-reads the table for these, so only call after publishing
+    requestReportSchedule(pin);
+    if (oldMode == PinMode::INPUT_MODE || oldMode == PinMode::INPUT_PULLUP_MODE ||
+        newMode == PinMode::INPUT_MODE || newMode == PinMode::INPUT_PULLUP_MODE) {
+        requestReportSchedule(DEBOUNCE_SCHEDULE_ID);
+    }
+    if (oldMode == PinMode::COUNTER_MODE || newMode == PinMode::COUNTER_MODE) {
+        requestReportSchedule(COUNTER_SCHEDULE_ID);
+    }
+}
+
+void InputManager::releasePin(PinTable& table, uint8_t pin) {
+    PinState* state = &table.pins[pin];
+    
+    // Detach interrupt if needed
+    if (state->mode == PinMode::INTERRUPT_MODE) {
+        detachPinInterrupt(pin);
+    }
+    
+    // Stop any pulse or waveform still driving the pin
+    if (state->mode == PinMode::OUTPUT_MODE) {
+        sequencer.cancel(1ULL << pin);
+    }
+    
+    if (state->mode == PinMode::ANALOG_MODE) {
+        analogSampler.detach(pin);
+    }
+    
+    // Release the pulse counter unit
+    if (state->mode == PinMode::COUNTER_MODE) {
+        counters.detach(pin);
+    }
+    
+    // Remove from the table
+    table.configuredMask &= ~(1ULL << pin);
+    table.digitalInputMask &= ~(1ULL << pin);
+    table.polledInputMask &= ~(1ULL << pin);
+    table.topics.release(state->topic);
+    state->mode = PinMode::NONE;
+}
+
+void InputManager::publishInitialState(const PinConfig& pinConfig) {
+    if (pinConfig.mode == PinMode::OUTPUT_MODE || pinConfig.mode == PinMode::COUNTER_MODE) {
+        return;
+    }
+    
+    int value;
+    if (pinConfig.mode == PinMode::ANALOG_MODE) {
+        value = readAnalog(pinConfig.pin);
+    } else {
+        value = digitalRead(pinConfig.pin);
+    }
+    
+    // A freshly sampled analog pin has no filtered value yet; its first
+    // periodic report follows shortly
+    if (value >= 0) {
+        ConfigSnapshot<PinTable>::Reader table(pinTable);
+        publishPinState(*table, pinConfig.pin, value);
+    }
+}
+
+const char* InputManager::modeName(PinMode mode) {
+    switch (mode) {
+        case PinMode::OUTPUT_MODE: return "output";
+        case PinMode::INPUT_MODE: return "input";
+        case PinMode::INPUT_PULLUP_MODE: return "input_pullup";
+        case PinMode::ANALOG_MODE: return "analog";
+        case PinMode::INTERRUPT_MODE: return "interrupt";
+        case PinMode::COUNTER_MODE: return "counter";
+        default: return "none";
+    }
+}
+
+void InputManager::loadConfig() {
+    int64_t started = esp_timer_get_time();
+    pinRecords.begin();
+    
+    // One-time conversion of the JSON list written by earlier firmware
+    if (pinRecords.hasJson()) {
+        migrateJsonConfig();
+    }
+    
+    if (pinRecords.pins() == 0) {
+        Serial.println("No saved pin configurations");
+        return;
+    }
+    
+    uint8_t loaded = 0;
+    uint64_t pending = pinRecords.pins();
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        PinRecord record;
+        if (!pinRecords.read(pin, record)) {
+            Serial.println("ERROR: Invalid saved record for pin " + String(pin) + ", discarding");
+            pinRecords.erase(pin);
+            continue;
+        }
+        
+        PinConfig pinConfig;
+        unpackPinRecord(record, pinConfig);
+        if (!validatePin(pin) || !validatePinMode(pin, pinConfig.mode) || !applyPinConfig(pinConfig)) {
+            continue;
+        }
+        
+        publishInitialState(pinConfig);
+        loaded++;
+    }
+    
+    Serial.println("Loaded " + String(loaded) + " pin configurations in " +
+                   String((uint32_t)(esp_timer_get_time() - started)) + " us");
+}
+
+void InputManager::migrateJsonConfig() {
+    int migrated = pinRecords.migrateJson([this](JsonVariantConst entry, PinRecord& record) {
+        PinConfig pinConfig;
+        if (!parsePinConfig(entry, pinConfig) || pinConfig.reportTopic.length() >= PIN_RECORD_TOPIC_SIZE) {
+            return false;
+        }
+        packPinRecord(pinConfig, record);
+        return true;
+    });
+    
+    if (migrated < 0) {
+        Serial.println("ERROR: Failed to parse saved config, dropping it");
+    } else {
+        Serial.println("Migrated " + String(migrated) + " pin configurations to binary records");
+    }
+}
+
+void InputManager::savePinRecord(const PinConfig& config) {
+    int64_t started = esp_timer_get_time();
+    
+    PinRecord record;
+    packPinRecord(config, record);
+    
+    PinRecordWrite result = pinRecords.write(record);
+    if (result == PinRecordWrite::FAILED) {
+        Serial.println("ERROR: Failed to save pin " + String(config.pin));
+    } else if (result == PinRecordWrite::WRITTEN) {
+        Serial.println("Pin " + String(config.pin) + " saved (" + String(sizeof(record)) + " bytes in " +
+                       String((uint32_t)(esp_timer_get_time() - started)) + " us)");
+    }
+}
+
+void InputManager::erasePinRecord(uint8_t pin) {
+    pinRecords.erase(pin);
+}
+
+void InputManager::loadBatchConfig() {
+    String batchJson = preferences.getString("batch", "");
+    if (batchJson.length() == 0) {
+        return;
+    }
+    
+    StaticJsonDocument<128> doc;
+    DeserializationError error = deserializeJson(doc, batchJson);
+    
+    if (error) {
+        Serial.println("ERROR: Failed to parse batch settings");
+        return;
+    }
+    
+    batchEnabled = doc["enabled"] | false;
+    batchWindowMs = doc["window"] | 100;
+    batchMax = constrain((int)(doc["max"] | 16), 1, (int)BATCH_CAPACITY);
+    batchPerPin = doc["per_pin"] | true;
+}
+
+void InputManager::saveBatchConfig() {
+    StaticJsonDocument<128> doc;
+    doc["enabled"] = batchEnabled;
+    doc["window"] = batchWindowMs;
+    doc["max"] = batchMax;
+    doc["per_pin"] = batchPerPin;
+    
+    String output;
+    serializeJson(doc, output);
+    preferences.putString("batch", output);
+    
+    Serial.println("Batch settings saved");
+}
+
+void InputManager::loadSnapshotConfig() {
+    String snapshotJson = preferences.getString("snapshot", "");
+    if (snapshotJson.length() == 0) {
+        return;
+    }
+    
+    StaticJsonDocument<64> doc;
+    DeserializationError error = deserializeJson(doc, snapshotJson);
+    
+    if (error) {
+        Serial.println("ERROR: Failed to parse snapshot settings");
+        return;
+    }
+    
+    snapshotEnabled = doc["enabled"] | false;
+    snapshotIntervalMs = doc["interval"] | 0;
+}
+
+void InputManager::saveSnapshotConfig() {
+    StaticJsonDocument<64> doc;
+    doc["enabled"] = snapshotEnabled;
+    doc["interval"] = snapshotIntervalMs;
+    
+    String output;
+    serializeJson(doc, output);
+    preferences.putString("snapshot", output);
+    
+    Serial.println("Snapshot settings saved");
+}
+
+void InputManager::loadRules() {
+    String rulesJson = preferences.getString("rules", "");
+    if (rulesJson.length() == 0) {
+        return;
+    }
+    
+    StaticJsonDocument<2048> doc;
+    DeserializationError error = deserializeJson(doc, rulesJson);
+    
+    if (error) {
+        Serial.println("ERROR: Failed to parse saved rules");
+        return;
+    }
+    
+    if (applyRules(doc.as<JsonArrayConst>())) {
+        Serial.println("Loaded " + String(doc.size()) + " saved IO rules");
+    }
+}
+
+bool InputManager::applyRules(JsonArrayConst rulesArray) {
+    if (rulesArray.size() > RuleProgram::MAX_RULES) {
+        Serial.println("ERROR: Too many rules (max " + String(RuleProgram::MAX_RULES) + ")");
+        return false;
+    }
+    
+    // Compile into the inactive copy; the worker keeps running the old rules
+    // until publish()
+    RuleProgram& program = rules.edit();
+    program.clear();
+    program.version = rules.version() + 1;
+    
+    uint8_t index = 0;
+    for (JsonVariantConst ruleConfig : rulesArray) {
+        RuleInstruction condition[RuleProgram::MAX_CODE];
+        uint8_t length = 0;
+        RuleAction onTrue = {RuleActionType::NONE, 0, 0};
+        RuleAction onFalse = {RuleActionType::NONE, 0, 0};
+        
+        if (!compileCondition(ruleConfig["when"], condition, length, 0) ||
+            !parseRuleAction(ruleConfig["do"], onTrue) ||
+            (ruleConfig.containsKey("else") && !parseRuleAction(ruleConfig["else"], onFalse))) {
+            Serial.println("ERROR: Invalid rule " + String(index));
+            return false;
+        }
+        
+        if (!program.addRule(condition, length, onTrue, onFalse)) {
+            Serial.println("ERROR: Rule " + String(index) + " does not fit the rule program");
+            return false;
+        }
+        index++;
+    }
+    
+    rules.publish();
+    return true;
+}
+
+bool InputManager::compileCondition(JsonVariantConst condition, RuleInstruction* code, uint8_t& length, uint8_t depth) {
+    if (depth > MAX_RULE_NESTING) {
+        Serial.println("ERROR: Rule condition nested too deeply");
+        return false;
+    }
+    
+    if (!condition.is<JsonObjectConst>()) {
+        Serial.println("ERROR: Rule condition must be an object");
+        return false;
+    }
+    
+    // Combinators compile their operands first, then the operator (postfix)
+    bool all = condition.containsKey("all");
+    if (all || condition.containsKey("any")) {
+        const char* group = all ? "all" : "any";
+        JsonArrayConst operands = condition[group];
+        if (operands.size() == 0) {
+            Serial.println("ERROR: Empty '" + String(group) + "' condition");
+            return false;
+        }
+        
+        for (JsonVariantConst operand : operands) {
+            if (!compileCondition(operand, code, length, depth + 1)) {
+                return false;
+            }
+        }
+        
+        if (operands.size() > 1) {
+            if (length >= RuleProgram::MAX_CODE) {
+                Serial.println("ERROR: Rule condition too long");
+                return false;
+            }
+            code[length++] = {all ? RuleOp::AND : RuleOp::OR, 0, (uint16_t)operands.size()};
+        }
+        return true;
+    }
+    
+    if (condition.containsKey("not")) {
+        if (!compileCondition(condition["not"], code, length, depth + 1)) {
+            return false;
+        }
+        if (length >= RuleProgram::MAX_CODE) {
+            Serial.println("ERROR: Rule condition too long");
+            return false;
+        }
+        code[length++] = {RuleOp::NOT, 0, 0};
+        return true;
+    }
+    
+    // Leaf: a test on one input pin
+    if (!condition["pin"].is<uint8_t>()) {
+        Serial.println("ERROR: Rule condition missing pin");
+        return false;
+    }
+    
+    uint8_t pin = condition["pin"];
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    const PinState* state = table->find(pin);
+    if (state == nullptr) {
+        Serial.println("ERROR: Rule input pin " + String(pin) + " not configured");
+        return false;
+    }
+    
+    RuleInstruction insn = {RuleOp::LEVEL, pin, 0};
+    if (condition.containsKey("edge") || condition.containsKey("level")) {
+        if (!isDigitalInput(state->mode)) {
+            Serial.println("ERROR: Rule input pin " + String(pin) + " is not a digital input");
+            return false;
+        }
+        
+        if (condition.containsKey("edge")) {
+            String edge = condition["edge"] | "";
+            if (edge == "rising") {
+                insn.op = RuleOp::ROSE;
+            } else if (edge == "falling") {
+                insn.op = RuleOp::FELL;
+            } else if (edge == "change") {
+                insn.op = RuleOp::CHANGED;
+            } else {
+                Serial.println("ERROR: Invalid rule edge: " + edge);
+                return false;
+            }
+        } else {
+            insn.arg = (condition["level"] | 0) ? 1 : 0;
+        }
+    } else if (condition.containsKey("above") || condition.containsKey("below")) {
+        if (state->mode != PinMode::ANALOG_MODE) {
+            Serial.println("ERROR: Rule input pin " + String(pin) + " is not analog");
+            return false;
+        }
+        
+        bool above = condition.containsKey("above");
+        insn.op = above ? RuleOp::ABOVE : RuleOp::BELOW;
+        insn.arg = condition[above ? "above" : "below"] | 0;
+    } else {
+        Serial.println("ERROR: Rule condition on pin " + String(pin) + " has no test");
+        return false;
+    }
+    
+    if (length >= RuleProgram::MAX_CODE) {
+        Serial.println("ERROR: Rule condition too long");
+        return false;
+    }
+    code[length++] = insn;
+    return true;
+}
+
+bool InputManager::parseRuleAction(JsonVariantConst config, RuleAction& action) {
+    if (!config["pin"].is<uint8_t>()) {
+        Serial.println("ERROR: Rule action missing pin");
+        return false;
+    }
+    
+    uint8_t pin = config["pin"];
+    ConfigSnapshot<PinTable>::Reader table(pinTable);
+    const PinState* state = table->find(pin);
+    if (state == nullptr || state->mode != PinMode::OUTPUT_MODE) {
+        Serial.println("ERROR: Rule target pin " + String(pin) + " not configured as output");
+        return false;
+    }
+    
+    String type = config["action"] | "";
+    action.pin = pin;
+    action.pulseMs = config["pulse"] | table->settings[pin].pulseWidthMs;
+    
+    if (type == "set") {
+        action.type = RuleActionType::SET;
+    } else if (type == "reset") {
+        action.type = RuleActionType::RESET;
+    } else if (type == "pulse") {
+        action.type = RuleActionType::PULSE;
+    } else if (type == "toggle") {
+        action.type = RuleActionType::TOGGLE;
+    } else {
+        Serial.println("ERROR: Invalid rule action: " + type);
+        return false;
+    }
+    return true;
+}
+
+void InputManager::loadExcludeList() {
+    String excludeJson = preferences.getString("exclude", "");
+    if (excludeJson.length() == 0) {
+        Serial.println("No saved exclude list");
+        return;
+    }
+    
+    StaticJsonDocument<512> doc;
+    DeserializationError error = deserializeJson(doc, excludeJson);
+    
+    if (error) {
+        Serial.println("ERROR: Failed to parse exclude list");
+        return;
+    }
+    
+    excludedPins.clear();
+    excludedRanges.clear();
+    
+    JsonArray pinsArray = doc["pins"];
+    for (JsonVariant pin : pinsArray) {
+        excludedPins.push_back(pin.as<uint8_t>());
+    }
+    
+    JsonArray rangesArray = doc["ranges"];
+    for (JsonVariant rangeVariant : rangesArray) {
+        JsonObject rangeObj = rangeVariant.as<JsonObject>();
+        uint8_t from = rangeObj["from"];
+        uint8_t to = rangeObj["to"];
+        excludedRanges.push_back(std::make_pair(from, to));
+    }
+    updateExcludedMask();
+    
+    Serial.println("Loaded exclude list: " + String(excludedPins.size()) + 
+                   " pins, " + String(excludedRanges.size()) + " ranges");
+}
+
+void InputManager::saveExcludeList(const std::vector<uint8_t>& pins,
+                                   const std::vector<std::pair<uint8_t, uint8_t>>& ranges,
+                                   bool persist) {
+    StaticJsonDocument<512> doc;
+    
+    JsonArray pinsArray = doc.createNestedArray("pins");
+    for (uint8_t pin : pins) {
+        pinsArray.add(pin);
+    }
+    
+    JsonArray rangesArray = doc.createNestedArray("ranges");
+    for (auto& range : ranges) {
+        JsonObject rangeObj = rangesArray.createNestedObject();
+        rangeObj["from"] = range.first;
+        rangeObj["to"] = range.second;
+    }
+    
+    String output;
+    serializeJson(doc, output);
+    preferences.putString("exclude", output);
+    
+    Serial.println("Exclude list saved");
+}
+
+void InputManager::updateExcludedMask() {
+    uint64_t mask = 0;
+    
+    for (uint8_t pin : excludedPins) {
+        if (pin < 64) {
+            mask |= (1ULL << pin);
+        }
+    }
+    
+    for (auto& range : excludedRanges) {
+        if (range.first <= range.second && range.first < 64) {
+            mask |= gpioRange(range.first, std::min<uint8_t>(range.second, 63));
+        }
+    }
+    
+    excludedMask = mask;
+}
+
+bool InputManager::isPinExcluded(uint8_t pin) {
+    return (excludedMask >> pin) & 0x1;
+}
+
+bool InputManager::isPinReserved(uint8_t pin) {
+    return (BOARD_PROFILE.flash >> pin) & 0x1;
+}
+
+bool InputManager::validatePin(uint8_t pin) {
+    if (pin >= MAX_PINS || !((BOARD_PROFILE.gpio >> pin) & 0x1)) {
+        Serial.println("ERROR: Pin " + String(pin) + " does not exist");
+        return false;
+    }
+    
+    if (isPinReserved(pin)) {
+        Serial.println("ERROR: Pin " + String(pin) + " is reserved");
+        return false;
+    }
+    
+    if (isPinExcluded(pin)) {
+        Serial.println("ERROR: Pin " + String(pin) + " is excluded");
+        return false;
+    }
+    
+    return true;
+}
+
+bool InputManager::validatePinMode(uint8_t pin, PinMode mode) {
+    uint64_t bit = 1ULL << pin;
+    
+    if ((mode == PinMode::OUTPUT_MODE || mode == PinMode::INPUT_PULLUP_MODE) &&
+        (BOARD_PROFILE.inputOnly & bit)) {
+        Serial.println("ERROR: Pin " + String(pin) + " is input-only (no output driver or pull-up)");
+        return false;
+    }
+    
+    if (mode == PinMode::ANALOG_MODE && !((BOARD_PROFILE.adc1 | BOARD_PROFILE.adc2) & bit)) {
+        Serial.println("ERROR: Pin " + String(pin) + " has no ADC channel");
+        return false;
+    }
+    
+    if (BOARD_PROFILE.strapping & bit) {
+        Serial.println("WARNING: Pin " + String(pin) + " is a strapping pin and may affect boot");
+    }
+    
     return true;
 }
 
-void InputManager::configurePinHardware(const PinConfig& config) {
+bool InputManager::configurePinHardware(const PinConfig& config) {
     switch (config.mode) {
         case PinMode::OUTPUT_MODE:
             pinMode(config.pin, OUTPUT);
@@ -513,7 +1479,11 @@ void InputManager::configurePinHardware(const PinConfig& config) {
             break;
             
         case PinMode::ANALOG_MODE:
-            // Analog pins don't need pinMode on ESP32
+            // ADC1 pins are sampled continuously; anything the sampler
+            // refuses is read with analogRead() when a report is due
+            if (!analogSampler.attach(config.pin, config.filter)) {
+                Serial.println("Pin " + String(config.pin) + " read with analogRead (no continuous sampling)");
+            }
             break;
             
         case PinMode::INTERRUPT_MODE:
@@ -521,12 +1491,24 @@ void InputManager::configurePinHardware(const PinConfig& config) {
             attachPinInterrupt(config.pin, config.edge);
             break;
             
+        case PinMode::COUNTER_MODE:
+            // PCNT sets up the pin (input with pull-up) itself
+            return counters.attach(config.pin,
+                                   config.edge != InterruptEdge::FALLING_EDGE,
+                                   config.edge == InterruptEdge::FALLING_EDGE ||
+                                   config.edge == InterruptEdge::CHANGE_EDGE);
+            
         default:
             break;
     }
+    return true;
 }
 
 void InputManager::attachPinInterrupt(uint8_t pin, InterruptEdge edge) {
+    if (pin >= MAX_PINS) {
+        return;
+    }
+    
     // Store handler mapping
     isrHandlers[pin] = this;
     
@@ -551,36 +1533,35 @@ void InputManager::attachPinInterrupt(uint8_t pin, InterruptEdge edge) {
 
 void InputManager::detachPinInterrupt(uint8_t pin) {
     detachInterrupt(digitalPinToInterrupt(pin));
-    isrHandlers.erase(pin);
+    if (pin < MAX_PINS) {
+        isrHandlers[pin] = nullptr;
+    }
 }
 
 void IRAM_ATTR InputManager::handleInterrupt(void* arg) {
     uint8_t pin = (uint8_t)(uintptr_t)arg;
-    
-    auto it = isrHandlers.find(pin);
-    if (it == isrHandlers.end()) {
+    if (pin >= MAX_PINS) {
         return;
     }
     
-    InputManager* instance = it->second;
+    InputManager* instance = isrHandlers[pin];
+    if (instance == nullptr || instance->workerTaskHandle == nullptr) {
+        return;
+    }
     
     // Create event
     IOEvent event;
     event.pin = pin;
     event.type = EventType::DIGITAL;
-    event.value = digitalRead(pin);
-    event.timestamp = millis();
+    // Register read instead of digitalRead(), which is not IRAM-safe
+    event.value = GpioPort::readLevel(pin);
+    event.timestamp = esp_timer_get_time();
     
-    // Try to queue event
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    
-    // If queue is full, remove oldest item and add new one
-    if (uxQueueSpacesAvailable(instance->eventQueue) == 0) {
-        IOEvent dummy;
-        xQueueReceiveFromISR(instance->eventQueue, &dummy, &xHigherPriorityTaskWoken);
-    }
+    // Push never blocks; when the ring is full the oldest event is dropped
+    instance->isrEvents.push(event);
     
-    xQueueSendFromISR(instance->eventQueue, &event, &xHigherPriorityTaskWoken);
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(instance->workerTaskHandle, &xHigherPriorityTaskWoken);
     
     if (xHigherPriorityTaskWoken) {
         portYIELD_FROM_ISR();
@@ -590,90 +1571,757 @@ void IRAM_ATTR InputManager::handleInterrupt(void* arg) {
 void InputManager::workerTaskFunction(void* parameter) {
     InputManager* instance = static_cast<InputManager*>(parameter);
     IOEvent event;
+    uint32_t reportedDrops = 0;
     
     while (true) {
-        // Wait for event (block indefinitely)
-        if (xQueueReceive(instance->eventQueue, &event, portMAX_DELAY) == pdTRUE) {
-            instance->processEvent(event);
+        // Wait until the ISR or queueEvent() signals new work, or until the
+        // next open edge burst is due to close. No snapshot is held while
+        // blocked, so configuration changes never wait on an idle worker.
+        TickType_t wait;
+        {
+            ConfigSnapshot<PinTable>::Reader table(instance->pinTable);
+            wait = instance->ticksUntilNextDeadline(*table, esp_timer_get_time());
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+        
+        {
+            // One consistent configuration for this whole round of work
+            ConfigSnapshot<PinTable>::Reader table(instance->pinTable);
+            
+            // Drain interrupt events first, they are the most time sensitive
+            while (instance->isrEvents.pop(event)) {
+                instance->coalesceEdge(*table, event);
+            }
+            
+            instance->applyPendingSchedules(*table);
+            
+            while (xQueueReceive(instance->eventQueue, &event, 0) == pdTRUE) {
+                instance->processEvent(*table, event);
+            }
+            
+            int64_t now = esp_timer_get_time();
+            instance->runDueReports(*table, now);
+            instance->flushBursts(*table, now);
+        }
+        
+        if (instance->nextBatchFlushUs() <= esp_timer_get_time()) {
+            instance->flushBatch();
+        }
+        
+        uint32_t drops = instance->isrEvents.droppedCount();
+        if (drops != reportedDrops) {
+            Serial.println("WARNING: " + String(drops - reportedDrops) + " interrupt events dropped");
+            reportedDrops = drops;
         }
     }
 }
 
-void InputManager::processEvent(const IOEvent& event) {
-    auto it = configuredPins.find(event.pin);
-    if (it == configuredPins.end()) {
+void InputManager::processEvent(const PinTable& table, const IOEvent& event) {
+    const PinState* state = table.find(event.pin);
+    if (state == nullptr) {
         return;
     }
     
-    PinConfig& config = it->second;
+    const PinState& config = *state;
+    PinRuntime& pinRuntime = runtimeFor(config, event.pin);
     
-    // Apply debounce
-    unsigned long now = millis();
-    if (config.debounceMs > 0) {
-        if (now - config.lastReportTime < config.debounceMs) {
-            return; // Too soon, ignore
-        }
+    // Output changes made by the sequencer are always reported
+    if (event.type == EventType::TRIGGER) {
+        pinRuntime.lastValue = event.value;
+        publishPinState(table, event.pin, event.value, event.timestamp);
+        return;
     }
     
+    // Digital inputs arrive here already debounced (vertical counter for
+    // polled pins, burst coalescing for interrupt pins). Rules see every
+    // reading, including ones held back from MQTT below.
+    runRules(table, event.pin, event.value);
+    
+    unsigned long now = millis();
+    
     // Check if value changed (for on-change reporting)
-    if (config.lastValue == event.value && config.reportIntervalMs == 0) {
+    if (pinRuntime.lastValue == event.value && config.reportIntervalMs == 0) {
         return; // No change, skip reporting
     }
     
-    config.lastValue = event.value;
-    config.lastReportTime = now;
+    // Analog readings inside the deadband are held back until the
+    // heartbeat says the topic has been silent for too long
+    if (event.type == EventType::ANALOG_READ && pinRuntime.lastValue >= 0 &&
+        withinDeadband(config, pinRuntime, event.value) &&
+        (config.heartbeatMs == 0 || now - pinRuntime.lastReportTime < config.heartbeatMs)) {
+        pinRuntime.suppressedCount++;
+        suppressedPublishes++;
+        return;
+    }
+    
+    pinRuntime.lastValue = event.value;
+    pinRuntime.lastReportTime = now;
     
     // Publish state
-    publishPinState(event.pin, event.value);
+    publishPinState(table, event.pin, event.value, event.timestamp);
+}
+
+PinRuntime& InputManager::runtimeFor(const PinState& state, uint8_t pin) {
+    // A new generation means the pin was (re)configured since the worker
+    // last saw it, so its reporting history no longer applies
+    PinRuntime& pinRuntime = runtime[pin];
+    if (pinRuntime.generation != state.generation) {
+        pinRuntime.lastValue = -1;
+        pinRuntime.lastReportTime = 0;
+        pinRuntime.suppressedCount = 0;
+        pinRuntime.counterReported = 0;
+        pinRuntime.generation = state.generation;
+    }
+    return pinRuntime;
+}
+
+bool InputManager::withinDeadband(const PinState& config, const PinRuntime& pinRuntime, int value) {
+    if (config.deadband == 0 && config.deadbandPermille == 0) {
+        return false;
+    }
+    
+    // The larger of the absolute and relative bands applies, both measured
+    // from the last published value
+    uint32_t delta = (uint32_t)abs(value - pinRuntime.lastValue);
+    uint32_t relative = ((uint32_t)abs(pinRuntime.lastValue) * config.deadbandPermille) / 1000;
+    return delta <= std::max<uint32_t>(config.deadband, relative);
+}
+
+void InputManager::requestReportSchedule(uint8_t pin) {
+    portENTER_CRITICAL(&scheduleLock);
+    pendingSchedules |= 1ULL << pin;
+    portEXIT_CRITICAL(&scheduleLock);
+    
+    if (workerTaskHandle != nullptr) {
+        xTaskNotifyGive(workerTaskHandle);
+    }
+}
+
+void InputManager::applyPendingSchedules(const PinTable& table) {
+    portENTER_CRITICAL(&scheduleLock);
+    uint64_t pending = pendingSchedules;
+    pendingSchedules = 0;
+    portEXIT_CRITICAL(&scheduleLock);
+    
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        updateReportSchedule(table, pin);
+    }
+}
+
+void InputManager::updateReportSchedule(const PinTable& table, uint8_t pin) {
+    uint32_t intervalMs = 0;
+    
+    if (pin == DEBOUNCE_SCHEDULE_ID) {
+        updateDebounceTick(table);
+        intervalMs = debounceTickMs;
+    } else if (pin == SNAPSHOT_SCHEDULE_ID) {
+        intervalMs = snapshotEnabled ? snapshotIntervalMs : 0;
+    } else if (pin == COUNTER_SCHEDULE_ID) {
+        intervalMs = counters.isActive() ? PulseCounter::POLL_INTERVAL_MS : 0;
+    } else {
+        const PinState* state = table.find(pin);
+        if (state != nullptr && table.topics.length(state->topic) > 0) {
+            intervalMs = state->reportIntervalMs;
+        }
+    }
+    
+    if (intervalMs == 0) {
+        reportSchedule.cancel(pin);
+        return;
+    }
+    
+    reportSchedule.schedule(pin, esp_timer_get_time() + (int64_t)intervalMs * 1000);
+}
+
+void InputManager::runDueReports(const PinTable& table, int64_t now) {
+    uint8_t pin;
+    int64_t due;
+    
+    // Only pins whose deadline has passed are touched
+    while (reportSchedule.popDue(now, pin, due)) {
+        uint32_t intervalMs;
+        
+        if (pin == DEBOUNCE_SCHEDULE_ID) {
+            if (debounceTickMs == 0) {
+                continue;
+            }
+            intervalMs = debounceTickMs;
+            runDebounceTick(table, now);
+        } else if (pin == SNAPSHOT_SCHEDULE_ID) {
+            if (!snapshotEnabled || snapshotIntervalMs == 0) {
+                continue;
+            }
+            intervalMs = snapshotIntervalMs;
+            publishSnapshot(table);
+        } else if (pin == COUNTER_SCHEDULE_ID) {
+            if (!counters.isActive()) {
+                continue;
+            }
+            intervalMs = PulseCounter::POLL_INTERVAL_MS;
+            counters.poll(now);
+        } else {
+            const PinState* state = table.find(pin);
+            if (state == nullptr || state->reportIntervalMs == 0) {
+                continue;
+            }
+            
+            const PinState& config = *state;
+            intervalMs = config.reportIntervalMs;
+            
+            // Digital inputs are covered by the port snapshot in snapshot mode
+            if (config.mode == PinMode::COUNTER_MODE) {
+                publishCounter(table, pin, now, runtimeFor(config, pin).counterReported);
+            } else if (!(snapshotEnabled && isDigitalInput(config.mode))) {
+                IOEvent event;
+                event.pin = pin;
+                event.type = (config.mode == PinMode::ANALOG_MODE) ? EventType::ANALOG_READ : EventType::DIGITAL;
+                if (config.mode == PinMode::ANALOG_MODE) {
+                    event.value = readAnalog(pin);
+                } else if (debouncedMask & (1ULL << pin)) {
+                    // Report the debounced level, not a raw sample mid-bounce
+                    event.value = (debouncer.stable() >> pin) & 0x1;
+                } else {
+                    event.value = digitalRead(pin);
+                }
+                event.timestamp = esp_timer_get_time();
+                if (event.value >= 0) {
+                    processEvent(table, event);
+                }
+            }
+        }
+        
+        // Keep a fixed cadence; if we fell more than one period behind,
+        // restart from now instead of firing a catch-up burst
+        int64_t intervalUs = (int64_t)intervalMs * 1000;
+        int64_t next = due + intervalUs;
+        if (next <= now) {
+            next = now + intervalUs;
+        }
+        reportSchedule.schedule(pin, next);
+    }
+}
+
+void InputManager::updateDebounceTick(const PinTable& table) {
+    // Pins with debounce 0 are not filtered; they are read as-is on their
+    // report interval
+    uint64_t debounced = 0;
+    uint16_t shortest = UINT16_MAX;
+    uint64_t pending = table.polledInputMask;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        uint16_t debounceMs = table.pins[pin].debounceMs;
+        if (debounceMs > 0) {
+            debounced |= (1ULL << pin);
+            shortest = std::min(shortest, debounceMs);
+        }
+    }
+    
+    // Seed newly added pins with their current level so they don't report a
+    // spurious transition on the first samples
+    uint64_t added = debounced & ~debouncedMask;
+    if (added != 0) {
+        debouncer.seed(added, GpioPort::readInputs());
+    }
+    debouncedMask = debounced;
+    
+    if (debounced == 0) {
+        debounceTickMs = 0;
+        return;
+    }
+    
+    // A transition needs SAMPLES agreeing samples, so tick fast enough for
+    // the shortest debounce window among the debounced pins
+    uint32_t tick = shortest / VerticalDebouncer::SAMPLES;
+    debounceTickMs = tick < DEBOUNCE_TICK_MIN_MS ? DEBOUNCE_TICK_MIN_MS : tick;
+}
+
+void InputManager::runDebounceTick(const PinTable& table, int64_t now) {
+    uint64_t toggled = debouncer.sample(GpioPort::readInputs()) & debouncedMask;
+    uint64_t levels = debouncer.stable();
+    
+    while (toggled != 0) {
+        uint8_t pin = __builtin_ctzll(toggled);
+        toggled &= toggled - 1;
+        
+        IOEvent event;
+        event.pin = pin;
+        event.type = EventType::DIGITAL;
+        event.value = (levels >> pin) & 0x1;
+        event.timestamp = now;
+        processEvent(table, event);
+    }
+}
+
+bool InputManager::isDigitalInput(PinMode mode) {
+    return mode == PinMode::INPUT_MODE ||
+           mode == PinMode::INPUT_PULLUP_MODE ||
+           mode == PinMode::INTERRUPT_MODE;
+}
+
+void InputManager::coalesceEdge(const PinTable& table, const IOEvent& event) {
+    if (table.find(event.pin) == nullptr) {
+        return;
+    }
+    
+    EdgeBurst& burst = bursts[event.pin];
+    if (burst.edges == 0) {
+        burst.firstUs = event.timestamp;
+        
+        // Rules react to the leading edge instead of waiting for the burst
+        // to settle
+        runRules(table, event.pin, event.value);
+    }
+    burst.lastUs = event.timestamp;
+    burst.level = event.value;
+    burst.edges++;
+    openBursts |= (1ULL << event.pin);
+}
+
+void InputManager::flushBursts(const PinTable& table, int64_t now) {
+    uint64_t pending = openBursts;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        const PinState* state = table.find(pin);
+        if (state == nullptr) {
+            // Pin was removed while the burst was open
+            bursts[pin].edges = 0;
+            openBursts &= ~(1ULL << pin);
+            continue;
+        }
+        
+        EdgeBurst& burst = bursts[pin];
+        int64_t quietUs = (int64_t)state->debounceMs * 1000;
+        bool settled = (now - burst.lastUs >= quietUs);
+        if (!settled && now - burst.firstUs < MAX_BURST_US) {
+            continue; // Still bouncing
+        }
+        
+        publishBurst(table, pin, burst, settled);
+        burst.edges = 0;
+        openBursts &= ~(1ULL << pin);
+    }
+}
+
+int64_t InputManager::nextBurstCloseUs(const PinTable& table) {
+    int64_t nextClose = INT64_MAX;
+    uint64_t pending = openBursts;
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+        
+        const PinState* state = table.find(pin);
+        int64_t quietUs = (state != nullptr) ? (int64_t)state->debounceMs * 1000 : 0;
+        int64_t close = std::min(bursts[pin].lastUs + quietUs, bursts[pin].firstUs + MAX_BURST_US);
+        nextClose = std::min(nextClose, close);
+    }
+    return nextClose;
+}
+
+TickType_t InputManager::ticksUntilNextDeadline(const PinTable& table, int64_t now) {
+    int64_t next = std::min(reportSchedule.nextDue(),
+                            std::min(nextBurstCloseUs(table), nextBatchFlushUs()));
+    if (next == INT64_MAX) {
+        return portMAX_DELAY;
+    }
+    
+    if (next <= now) {
+        return 0;
+    }
+    
+    TickType_t ticks = pdMS_TO_TICKS((next - now + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+void InputManager::publishBurst(const PinTable& table, uint8_t pin, const EdgeBurst& burst, bool settled) {
+    const PinState* state = table.find(pin);
+    if (state == nullptr) {
+        return;
+    }
+    
+    const PinState& config = *state;
+    
+    // Once the pin has been quiet for the debounce window its current level is
+    // the settled one. A burst cut short by MAX_BURST_US is still chattering,
+    // so report the last level sampled by the ISR instead.
+    int level = settled ? digitalRead(pin) : burst.level;
+    
+    runRules(table, pin, level);
+    
+    PinRuntime& pinRuntime = runtimeFor(config, pin);
+    pinRuntime.lastValue = level;
+    pinRuntime.lastReportTime = millis();
+    
+    publishPinState(table, pin, level, burst.lastUs);
+    
+    // Only chattering contacts get the extra burst record
+    if (burst.edges > 1 && mqttManager != nullptr && table.topics.length(config.topic) > 0) {
+        StaticJsonDocument<192> doc;
+        doc["level"] = level;
+        doc["edges"] = burst.edges;
+        doc["first_us"] = burst.firstUs;
+        doc["last_us"] = burst.lastUs;
+        
+        char topic[MQTT_BUFFER_SIZE / 4];
+        size_t length = snprintf(topic, sizeof(topic), "%s/burst", table.topics.get(config.topic));
+        if (length < sizeof(topic)) {
+            mqttManager->publishJson(topic, doc, false);
+        }
+    }
 }
 
-void InputManager::applyTrigger(uint8_t pin, TriggerType type, uint16_t pulseWidthMs) {
+bool InputManager::applyTrigger(const PinTable& table, uint8_t pin, TriggerType type, uint16_t pulseWidthMs) {
     switch (type) {
         case TriggerType::SET:
+            sequencer.cancel(1ULL << pin);
             digitalWrite(pin, HIGH);
-            publishPinState(pin, HIGH);
+            publishPinState(table, pin, HIGH);
             break;
             
         case TriggerType::RESET:
+            sequencer.cancel(1ULL << pin);
             digitalWrite(pin, LOW);
-            publishPinState(pin, LOW);
+            publishPinState(table, pin, LOW);
             break;
             
         case TriggerType::PULSE:
-            digitalWrite(pin, HIGH);
-            publishPinState(pin, HIGH);
-            delay(pulseWidthMs);
-            digitalWrite(pin, LOW);
-            publishPinState(pin, LOW);
+            // The sequencer ends the pulse from a timer; LOW is published
+            // by the worker when it completes. With every sequence slot busy
+            // the pin is left untouched and the trigger fails.
+            if (!sequencer.pulse(pin, (uint32_t)pulseWidthMs * 1000)) {
+                Serial.println("ERROR: Pulse on pin " + String(pin) + " not started");
+                return false;
+            }
+            publishPinState(table, pin, HIGH);
             break;
             
         case TriggerType::TOGGLE: {
+            sequencer.cancel(1ULL << pin);
             int currentState = digitalRead(pin);
             int newState = !currentState;
             digitalWrite(pin, newState);
-            publishPinState(pin, newState);
+            publishPinState(table, pin, newState);
             break;
         }
             
         default:
-            break;
+            return false;
+    }
+    return true;
+}
+
+void InputManager::onSequenceDone(uint64_t pinMask, uint8_t level) {
+    // Runs on the esp_timer task; hand the report over to the worker
+    int64_t now = esp_timer_get_time();
+    while (pinMask != 0) {
+        IOEvent event;
+        event.pin = __builtin_ctzll(pinMask);
+        event.type = EventType::TRIGGER;
+        event.value = level;
+        event.timestamp = now;
+        queueEvent(event);
+        pinMask &= pinMask - 1;
     }
 }
 
-void InputManager::publishPinState(uint8_t pin, int value) {
-    auto it = configuredPins.find(pin);
-    if (it == configuredPins.end() || mqttManager == nullptr) {
+void InputManager::publishPinState(const PinTable& table, uint8_t pin, int value, int64_t timestamp) {
+    const PinState* state = table.find(pin);
+    if (state == nullptr) {
         return;
     }
     
-    PinConfig& config = it->second;
+    const PinState& config = *state;
     
-    if (config.reportTopic.length() == 0) {
+    if (timestamp == 0) {
+        timestamp = esp_timer_get_time();
+    }
+    
+    // Kept even while MQTT is down, so gaps can be backfilled later
+    EventType type = EventType::DIGITAL;
+    if (config.mode == PinMode::ANALOG_MODE) {
+        type = EventType::ANALOG_READ;
+    } else if (config.mode == PinMode::OUTPUT_MODE) {
+        type = EventType::TRIGGER;
+    }
+    recordHistory(pin, type, value, timestamp);
+    
+    if (mqttManager == nullptr) {
         return;
     }
     
+    if (table.topics.length(config.topic) == 0) {
+        return;
+    }
+    
+    if (batchEnabled) {
+        if (appendToBatch(pin, value, timestamp)) {
+            flushBatch();
+        }
+        if (!batchPerPin) {
+            return;
+        }
+    }
+    
     // Publish state
-    mqttManager->publish(config.reportTopic, String(value), config.retain);
+    mqttManager->publishValue(table.topics.get(config.topic), value, config.retain);
+}
+
+int InputManager::readAnalog(uint8_t pin) {
+    // analogRead() would fight the DMA driver for ADC1, so a sampled pin
+    // without a filtered value yet reports nothing (-1)
+    if (analogSampler.owns(pin)) {
+        uint16_t value;
+        return analogSampler.read(pin, value) ? value : -1;
+    }
+    return analogRead(pin);
+}
+
+void InputManager::publishCounter(const PinTable& table, uint8_t pin, int64_t now, uint64_t& reportedTotal) {
+    const PinState* state = table.find(pin);
+    if (state == nullptr || mqttManager == nullptr) {
+        return;
+    }
+    
+    CounterReading reading;
+    if (!counters.read(pin, now, reading)) {
+        return;
+    }
+    
+    const PinState& config = *state;
+    
+    // 'count' is relative to the caller's own previous report
+    StaticJsonDocument<JSON_OBJECT_SIZE(3)> doc;
+    doc["count"] = (uint32_t)(reading.total - reportedTotal);
+    doc["total"] = reading.total;
+    reportedTotal = reading.total;
+    doc["hz"] = reading.hz;
+    
+    mqttManager->publishJson(table.topics.get(config.topic), doc, config.retain);
+}
+
+void InputManager::runRules(const PinTable& table, uint8_t pin, int value) {
+    ConfigSnapshot<RuleProgram>::Reader program(rules);
+    if (program->ruleCount == 0 || !((program->inputMask >> pin) & 0x1)) {
+        ruleEngine.setValue(pin, value);
+        return;
+    }
+    
+    // New rules start from the inputs' current levels, so only changes
+    // after they were loaded fire actions
+    if (ruleEngine.needsReset(*program)) {
+        seedRuleInputs(table, program->inputMask);
+        ruleEngine.reset(*program);
+    }
+    
+    RuleAction fired[RuleProgram::MAX_RULES];
+    uint8_t count = ruleEngine.update(*program, pin, value, fired, RuleProgram::MAX_RULES);
+    
+    for (uint8_t i = 0; i < count; i++) {
+        const RuleAction& action = fired[i];
+        
+        // The target may have been reconfigured since the rules were loaded
+        const PinState* target = table.find(action.pin);
+        if (target == nullptr || target->mode != PinMode::OUTPUT_MODE) {
+            continue;
+        }
+        
+        TriggerType type;
+        switch (action.type) {
+            case RuleActionType::SET:    type = TriggerType::SET; break;
+            case RuleActionType::RESET:  type = TriggerType::RESET; break;
+            case RuleActionType::PULSE:  type = TriggerType::PULSE; break;
+            case RuleActionType::TOGGLE: type = TriggerType::TOGGLE; break;
+            default:                     continue;
+        }
+        
+        if (!applyTrigger(table, action.pin, type, action.pulseMs)) {
+            if (mqttManager != nullptr) {
+                mqttManager->publishStatus("io_rule_action_failed");
+            }
+            continue;
+        }
+        ruleFires++;
+    }
+}
+
+void InputManager::seedRuleInputs(const PinTable& table, uint64_t mask) {
+    uint64_t levels = GpioPort::readInputs();
+    
+    while (mask != 0) {
+        uint8_t pin = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        
+        const PinState* state = table.find(pin);
+        if (state == nullptr || ruleEngine.value(pin) >= 0) {
+            continue;
+        }
+        
+        if (state->mode == PinMode::ANALOG_MODE) {
+            int value = readAnalog(pin);
+            if (value >= 0) {
+                ruleEngine.setValue(pin, value);
+            }
+        } else if (debouncedMask & (1ULL << pin)) {
+            ruleEngine.setValue(pin, (debouncer.stable() >> pin) & 0x1);
+        } else {
+            ruleEngine.setValue(pin, (levels >> pin) & 0x1);
+        }
+    }
+}
+
+void InputManager::recordHistory(uint8_t pin, EventType type, int value, int64_t timestamp) {
+    if (pin >= MAX_PINS) {
+        return;
+    }
+    
+    IOEvent event;
+    event.pin = pin;
+    event.type = type;
+    event.value = value;
+    event.timestamp = timestamp;
+    
+    // Periodic reports of an unchanged value are not activity
+    portENTER_CRITICAL(&historyLock);
+    if (historyLastValue[pin] != value) {
+        historyLastValue[pin] = value;
+        history.record(event);
+    }
+    portEXIT_CRITICAL(&historyLock);
+}
+
+void InputManager::streamHistory() {
+    if (!historyQuery.active) {
+        return;
+    }
+    
+    if (mqttManager == nullptr || !mqttManager->isConnected()) {
+        Serial.println("WARNING: History query " + historyQuery.id + " abandoned, MQTT disconnected");
+        historyQuery.active = false;
+        return;
+    }
+    
+    const HistoryQuery& query = historyQuery;
+    auto matches = [&query](const IOEvent& event) {
+        return (query.pin == HISTORY_ALL_PINS || event.pin == query.pin) &&
+               event.timestamp >= query.fromUs && event.timestamp <= query.toUs;
+    };
+    
+    // Fill one chunk, giving the lock back after every short scan
+    IOEvent events[HISTORY_CHUNK_MAX];
+    size_t count = 0;
+    while (count < historyQuery.chunkSize && (int32_t)(historyQuery.end - historyQuery.cursor) > 0) {
+        portENTER_CRITICAL(&historyLock);
+        if ((int32_t)(historyQuery.cursor - history.oldest()) < 0) {
+            historyQuery.complete = false;      // Overwritten while streaming
+        }
+        count += history.collect(historyQuery.cursor, historyQuery.end, matches,
+                                 events + count, historyQuery.chunkSize - count, HISTORY_SCAN_STEP);
+        portEXIT_CRITICAL(&historyLock);
+    }
+    bool done = (int32_t)(historyQuery.end - historyQuery.cursor) <= 0;
+    
+    StaticJsonDocument<JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(HISTORY_CHUNK_MAX) +
+                       HISTORY_CHUNK_MAX * JSON_ARRAY_SIZE(3)> doc;
+    if (historyQuery.id.length() > 0) {
+        doc["id"] = historyQuery.id.c_str();
+    }
+    doc["chunk"] = historyQuery.chunk;
+    doc["t"] = esp_timer_get_time();
+    
+    // Each event is [timestamp_us, pin, value]
+    JsonArray eventsArray = doc.createNestedArray("events");
+    for (size_t i = 0; i < count; i++) {
+        JsonArray entry = eventsArray.createNestedArray();
+        entry.add(events[i].timestamp);
+        entry.add(events[i].pin);
+        entry.add(events[i].value);
+    }
+    
+    if (done) {
+        doc["done"] = true;
+        doc["complete"] = historyQuery.complete;
+        historyQuery.active = false;
+    }
+    
+    mqttManager->publishJson(mqttManager->topic(DeviceTopic::IO_HISTORY), doc, false);
+    historyQuery.chunk++;
+}
+
+void InputManager::relaxWriter() {
+    // Let the worker finish the round it is in
+    vTaskDelay(1);
+}
+
+bool InputManager::appendToBatch(uint8_t pin, int value, int64_t timestamp) {
+    bool full;
+    bool opened = false;
+    
+    portENTER_CRITICAL(&batchLock);
+    if (batchCount == 0) {
+        batchOpenedUs = esp_timer_get_time();
+        opened = true;
+    }
+    if (batchCount < BATCH_CAPACITY) {
+        batchBuffer[batchCount++] = {pin, value, timestamp};
+    }
+    full = (batchCount >= batchMax);
+    portEXIT_CRITICAL(&batchLock);
+    
+    // Make sure the worker re-arms its timeout for the new window
+    if (opened && workerTaskHandle != nullptr &&
+        xTaskGetCurrentTaskHandle() != workerTaskHandle) {
+        xTaskNotifyGive(workerTaskHandle);
+    }
+    
+    return full;
+}
+
+int64_t InputManager::nextBatchFlushUs() {
+    if (batchCount == 0) {
+        return INT64_MAX;
+    }
+    return batchOpenedUs + (int64_t)batchWindowMs * 1000;
+}
+
+void InputManager::flushBatch() {
+    PinStateChange pending[BATCH_CAPACITY];
+    uint8_t count;
+    
+    // Take the collected changes and release the lock before publishing
+    portENTER_CRITICAL(&batchLock);
+    count = batchCount;
+    memcpy(pending, batchBuffer, count * sizeof(PinStateChange));
+    batchCount = 0;
+    portEXIT_CRITICAL(&batchLock);
+    
+    if (count == 0 || mqttManager == nullptr) {
+        return;
+    }
+    
+    // Compact layout: {"t": first_us, "s": [[pin, value, offset_us], ...]}
+    // where each offset is relative to "t"
+    StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(BATCH_CAPACITY) +
+                       BATCH_CAPACITY * JSON_ARRAY_SIZE(3)> doc;
+    int64_t base = pending[0].timestamp;
+    for (uint8_t i = 1; i < count; i++) {
+        base = std::min(base, pending[i].timestamp);
+    }
+    doc["t"] = base;
+    
+    JsonArray states = doc.createNestedArray("s");
+    for (uint8_t i = 0; i < count; i++) {
+        JsonArray entry = states.createNestedArray();
+        entry.add(pending[i].pin);
+        entry.add(pending[i].value);
+        entry.add((uint32_t)(pending[i].timestamp - base));
+    }
+    
+    mqttManager->publishJson(mqttManager->topic(DeviceTopic::IO_BATCH), doc, false);
 }
 
 bool InputManager::queueEvent(const IOEvent& event) {
@@ -687,5 +2335,12 @@ bool InputManager::queueEvent(const IOEvent& event) {
         xQueueReceive(eventQueue, &dummy, 0);
     }
     
-    return xQueueSend(eventQueue, &event, 0) == pdTRUE;
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        return false;
+    }
+    
+    if (workerTaskHandle != nullptr) {
+        xTaskNotifyGive(workerTaskHandle);
+    }
+    return true;
 }
@@ -1,20 +1,106 @@
 #include "MQTTManager.h"
 
-MQTTManager::MQTTManager() : mqttPort(1883), lastReconnectAttempt(0) {
+// Bytes per socket write when streaming a large publish
+static const size_t STREAM_CHUNK_BYTES = 128;
+
+// Serializes into a fixed region, such as a publish queue slot
+class FixedPrint : public Print {
+public:
+    FixedPrint(uint8_t* buffer, size_t size) : buffer(buffer), size(size), used(0) {}
+    
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+    
+    size_t write(const uint8_t* data, size_t length) override {
+        if (length > size - used) {
+            length = size - used;
+        }
+        memcpy(buffer + used, data, length);
+        used += length;
+        return length;
+    }
+
+private:
+    uint8_t* buffer;
+    size_t size;
+    size_t used;
+};
+
+// Collects serializer output into STREAM_CHUNK_BYTES writes to the client,
+// instead of one socket write per character
+class ChunkedPrint : public Print {
+public:
+    explicit ChunkedPrint(PubSubClient& client) : client(client), used(0), sent(0) {}
+    
+    size_t write(uint8_t c) override {
+        chunk[used++] = c;
+        if (used == sizeof(chunk)) {
+            flush();
+        }
+        return 1;
+    }
+    
+    size_t write(const uint8_t* data, size_t length) override {
+        for (size_t i = 0; i < length; i++) {
+            write(data[i]);
+        }
+        return length;
+    }
+    
+    void flush() override {
+        if (used > 0) {
+            sent += client.write(chunk, used);
+            used = 0;
+        }
+    }
+    
+    size_t sentBytes() const { return sent; }
+
+private:
+    PubSubClient& client;
+    uint8_t chunk[STREAM_CHUNK_BYTES];
+    size_t used;
+    size_t sent;
+};
+
+MQTTManager::MQTTManager()
+    : mqttPort(1883), connectState(ConnectState::WAITING), connectTask(nullptr), nextConnectAttempt(0),
+      connectFailures(0), announced(false), ownerTask(nullptr), failedCount(0), sentCount(0),
+      journalEnabled(false), encoding(PayloadEncoding::JSON) {
     mqttClient = new PubSubClient(wifiClient);
+    mqttClient->setBufferSize(MQTT_BUFFER_SIZE);
     clientId = "ESP32-Vault-" + String((uint32_t)ESP.getEfuseMac(), HEX);
     baseTopic = "esp32vault/" + clientId;
+    
+    if (!deviceTopics.build(baseTopic.c_str())) {
+        Serial.println("ERROR: Device topics truncated");
+    }
 }
 
 MQTTManager::~MQTTManager() {
+    if (connectTask != nullptr) {
+        vTaskDelete(connectTask);
+    }
     if (mqttClient != nullptr) {
         delete mqttClient;
     }
 }
 
 void MQTTManager::begin() {
+    ownerTask = xTaskGetCurrentTaskHandle();
     preferences.begin("mqtt", false);
     
+    registerCommands();
+    
+    encoding = (preferences.getUChar("encoding", 0) == 1) ? PayloadEncoding::MSGPACK : PayloadEncoding::JSON;
+    
+    // Messages journaled before a restart are replayed after the first connect
+    journalEnabled = preferences.getBool("journal", false);
+    if (journalEnabled && !journal.begin()) {
+        journalEnabled = false;
+    }
+    
     if (loadConfig()) {
         Serial.println("MQTT configuration loaded");
         mqttClient->setServer(mqttServer.c_str(), mqttPort);
@@ -24,32 +110,149 @@ void MQTTManager::begin() {
     } else {
         Serial.println("No MQTT configuration found");
     }
+    
+    // CONNACK wait; the TCP connect has its own timeout
+    mqttClient->setSocketTimeout(CONNECT_TIMEOUT_MS / 1000);
+    
+    // Connection attempts block on the network, so they run on their own
+    // task and never stall loop()
+    BaseType_t result = xTaskCreate(
+        connectTaskFunction,
+        "MQTTConnect",
+        4096,              // Stack size
+        this,              // Parameter (this pointer)
+        1,                 // Priority (same as the Arduino loop)
+        &connectTask
+    );
+    if (result != pdPASS) {
+        Serial.println("ERROR: Failed to create MQTT connect task");
+        connectTask = nullptr;
+    }
+    
+    // Spread the first attempt too, for fleets that power up together
+    nextConnectAttempt = millis() + random(RECONNECT_BACKOFF_MIN_MS);
 }
 
 void MQTTManager::loop() {
-    if (mqttClient->connected()) {
-        mqttClient->loop();
-    } else {
-        if (WiFi.status() == WL_CONNECTED) {
-            unsigned long now = millis();
-            if (now - lastReconnectAttempt > 5000) {
-                lastReconnectAttempt = now;
-                if (reconnect()) {
-                    lastReconnectAttempt = 0;
+    ownerTask = xTaskGetCurrentTaskHandle();
+    
+    switch (connectState.load()) {
+        case ConnectState::CONNECTED:
+            if (mqttClient->connected()) {
+                if (!announced) {
+                    announced = true;
+                    connectFailures = 0;
+                    publishStatus("online");
                 }
+                mqttClient->loop();
+                replayJournal();
+                drainQueue(MAX_SENDS_PER_LOOP);
+                return;
             }
-        }
+            Serial.println("MQTT connection lost");
+            scheduleReconnect();
+            break;
+        
+        case ConnectState::FAILED:
+            if (connectFailures < 0xFF) {
+                connectFailures++;
+            }
+            scheduleReconnect();
+            break;
+        
+        case ConnectState::WAITING:
+            if (connectTask != nullptr && mqttServer.length() > 0 && WiFi.status() == WL_CONNECTED &&
+                (long)(millis() - nextConnectAttempt) >= 0) {
+                connectState.store(ConnectState::RESOLVING);
+                xTaskNotifyGive(connectTask);
+            }
+            break;
+        
+        default:
+            break;  // Attempt in progress on the connect task
+    }
+    
+    // Move waiting messages to flash before the queue fills up
+    if (journalEnabled) {
+        drainQueue(MAX_SENDS_PER_LOOP);
     }
 }
 
 bool MQTTManager::isConnected() {
-    return mqttClient->connected();
+    return connectState.load() == ConnectState::CONNECTED;
 }
 
-void MQTTManager::setCallback(MQTTCallback callback) {
+const String& MQTTManager::getBaseTopic() const {
+    return baseTopic;
+}
+
+const char* MQTTManager::topic(DeviceTopic id) const {
+    return deviceTopics.get(id);
+}
+
+void MQTTManager::setCallback(MQTTMessageCallback callback) {
     messageCallback = callback;
 }
 
+void MQTTManager::setCallback(MQTTCallback callback) {
+    // Adapter for String handlers: one sized allocation per string
+    setCallback([callback](const char* topic, const uint8_t* payload, size_t length) {
+        String payloadStr;
+        payloadStr.reserve(length);
+        for (size_t i = 0; i < length; i++) {
+            payloadStr += (char)payload[i];
+        }
+        callback(String(topic), std::move(payloadStr));
+    });
+}
+
+bool MQTTManager::on(const String& pattern, TopicHandler handler) {
+    if (!router.on((baseTopic + "/" + pattern).c_str(), handler)) {
+        Serial.println("ERROR: Failed to register MQTT handler for " + pattern);
+        return false;
+    }
+    return true;
+}
+
+void MQTTManager::registerCommands() {
+    // Broker settings and the store-and-forward journal
+    on("cmd/mqtt", [this](const TopicMatch&, const char* payload, size_t length) {
+        StaticJsonDocument<256> doc;
+        DeserializationError error = decode(doc, payload, length);
+        
+        if (!error) {
+            String server = doc["server"] | "";
+            int port = doc["port"] | 1883;
+            String user = doc["user"] | "";
+            String password = doc["password"] | "";
+            
+            if (server.length() > 0) {
+                saveConfig(server, port, user, password);
+                publishStatus("mqtt_config_updated");
+                Serial.println("MQTT configuration updated via MQTT");
+            }
+            
+            // Store-and-forward journal on/off
+            if (doc.containsKey("journal")) {
+                if (setJournalEnabled(doc["journal"])) {
+                    publishStatus("mqtt_journal_updated");
+                } else {
+                    publishStatus("mqtt_journal_failed");
+                }
+            }
+            
+            // Payload encoding: "json" or "msgpack"
+            if (doc.containsKey("encoding")) {
+                if (setEncoding(doc["encoding"] | "")) {
+                    publishStatus("mqtt_encoding_updated");
+                } else {
+                    publishStatus("mqtt_encoding_failed");
+                }
+            }
+        }
+    });
+}
+
 void MQTTManager::setServer(const String& server, int port) {
     mqttServer = server;
     mqttPort = port;
@@ -87,77 +290,328 @@ void MQTTManager::saveConfig(const String& server, int port, const String& user,
 }
 
 void MQTTManager::publish(const String& topic, const String& payload, bool retained) {
-    if (mqttClient->connected()) {
-        mqttClient->publish(topic.c_str(), payload.c_str(), retained);
+    publish(topic.c_str(), payload.c_str(), payload.length(), retained);
+}
+
+void MQTTManager::publish(const char* topic, const char* payload, size_t length, bool retained) {
+    outbound.push(topic, reinterpret_cast<const uint8_t*>(payload), length, retained);
+    
+    // The owner can write right away, which keeps replies and OTA progress
+    // prompt even while loop() is not running
+    if (xTaskGetCurrentTaskHandle() == ownerTask) {
+        drainQueue(MQTT_QUEUE_SLOTS);
+    }
+}
+
+bool MQTTManager::publishJson(const char* topic, const JsonDocument& doc, bool retained) {
+    // Read once; the setting may change from another task
+    PayloadEncoding format = encoding;
+    size_t length = measurePayload(format, doc);
+    bool owner = xTaskGetCurrentTaskHandle() == ownerTask;
+    
+    if (owner && clientReady() && !OutboundQueue::fits(strlen(topic), length)) {
+        // A streamed message goes straight to the socket, so it must not
+        // overtake anything older
+        drainQueue(MQTT_QUEUE_SLOTS);
+        if (!hasBacklog()) {
+            return streamJson(topic, doc, format, length, retained);
+        }
+    }
+    
+    // Too large from any other task, while offline or behind a backlog is
+    // counted as a queue drop
+    bool queued = outbound.push(topic, length, retained, [&doc, format, length](uint8_t* payload) {
+        FixedPrint out(payload, length);
+        encodePayload(format, doc, out);
+    });
+    if (owner) {
+        drainQueue(MQTT_QUEUE_SLOTS);
+    }
+    return queued;
+}
+
+bool MQTTManager::streamJson(const char* topic, const JsonDocument& doc, PayloadEncoding format,
+                             size_t length, bool retained) {
+    if (!mqttClient->beginPublish(topic, length, retained)) {
+        failedCount++;
+        return false;
+    }
+    
+    ChunkedPrint out(*mqttClient);
+    encodePayload(format, doc, out);
+    out.flush();
+    
+    if (out.sentBytes() != length) {
+        // The broker is still waiting for the rest of the packet, so the
+        // session cannot be used any more
+        Serial.println("ERROR: Streamed publish to " + String(topic) + " was cut short");
+        mqttClient->disconnect();
+        failedCount++;
+        return false;
     }
+    
+    mqttClient->endPublish();
+    sentCount++;
+    return true;
+}
+
+void MQTTManager::publishValue(const char* topic, int32_t value, bool retained) {
+    char payload[12];
+    size_t length;
+    if (encoding == PayloadEncoding::MSGPACK) {
+        StaticJsonDocument<16> doc;
+        doc.set(value);
+        length = serializeMsgPack(doc, payload, sizeof(payload));
+    } else {
+        length = snprintf(payload, sizeof(payload), "%ld", (long)value);
+    }
+    publish(topic, payload, length, retained);
+}
+
+void MQTTManager::drainQueue(uint8_t maxMessages) {
+    OutboundQueue::Message message;
+    bool journaled = false;
+    
+    for (uint8_t i = 0; i < maxMessages && outbound.front(message); i++) {
+        // Offline, or older messages still waiting in the journal: append
+        // behind them so everything goes out in order
+        if (journalEnabled && (!clientReady() || journal.pending())) {
+            // While the replay runs, newer messages wait here and only
+            // spill to flash when the queue is filling up
+            if (clientReady() && outbound.depth() <= MQTT_QUEUE_SLOTS / 2) {
+                break;
+            }
+            if (!journal.append(message.topic, message.payload, message.payloadLength, message.retained)) {
+                break; // Kept in the queue, retried or sent once connected
+            }
+            outbound.pop();
+            journaled = true;
+            continue;
+        }
+        
+        if (!clientReady()) {
+            return; // Kept for after the reconnect
+        }
+        
+        if (mqttClient->publish(message.topic, message.payload, message.payloadLength, message.retained)) {
+            sentCount++;
+        } else if (!mqttClient->connected()) {
+            return; // Lost the connection mid-write, retry after reconnect
+        } else {
+            failedCount++;
+        }
+        outbound.pop();
+    }
+    
+    if (journaled) {
+        journal.flush();
+    }
+}
+
+void MQTTManager::replayJournal() {
+    // Bounded per pass so loop() stays responsive, but a backlog keeps
+    // draining on every pass until it is gone
+    unsigned long start = millis();
+    OutboundJournal::Record record;
+    while (millis() - start < JOURNAL_REPLAY_BUDGET_MS && journal.peek(record, replayBuffer, sizeof(replayBuffer))) {
+        if (mqttClient->publish(record.topic, record.payload, record.payloadLength, record.retained)) {
+            sentCount++;
+        } else if (!mqttClient->connected()) {
+            return; // Same record again after the reconnect
+        } else {
+            failedCount++;
+        }
+        journal.consume();
+    }
+}
+
+bool MQTTManager::hasBacklog() const {
+    return outbound.depth() > 0 || (journalEnabled && journal.pending());
+}
+
+PublishQueueStats MQTTManager::getQueueStats() const {
+    PublishQueueStats stats;
+    stats.depth = outbound.depth();
+    stats.highWater = outbound.highWaterMark();
+    stats.dropped = outbound.droppedCount();
+    stats.failed = failedCount;
+    stats.sent = sentCount;
+    return stats;
+}
+
+bool MQTTManager::setJournalEnabled(bool enabled) {
+    if (enabled && !journal.begin()) {
+        return false;
+    }
+    
+    journalEnabled = enabled;
+    preferences.putBool("journal", enabled);
+    
+    Serial.println("MQTT journal " + String(enabled ? "enabled" : "disabled"));
+    return true;
+}
+
+bool MQTTManager::isJournalEnabled() const {
+    return journalEnabled;
+}
+
+JournalStats MQTTManager::getJournalStats() const {
+    return journal.getStats();
+}
+
+bool MQTTManager::setEncoding(const char* name) {
+    PayloadEncoding next;
+    if (!parseEncoding(name, next)) {
+        Serial.println("ERROR: Unknown payload encoding " + String(name));
+        return false;
+    }
+    
+    encoding = next;
+    preferences.putUChar("encoding", next == PayloadEncoding::MSGPACK ? 1 : 0);
+    
+    Serial.println("MQTT payload encoding " + String(encodingName(next)));
+    return true;
+}
+
+PayloadEncoding MQTTManager::getEncoding() const {
+    return encoding;
+}
+
+DeserializationError MQTTManager::decode(JsonDocument& doc, const char* payload, size_t length) const {
+    return decodePayload(encoding, doc, payload, length);
 }
 
 void MQTTManager::subscribe(const String& topic) {
-    if (mqttClient->connected()) {
+    if (clientReady()) {
         mqttClient->subscribe(topic.c_str());
         Serial.print("Subscribed to: ");
         Serial.println(topic);
     }
 }
 
+void MQTTManager::publishStatus(const char* status) {
+    if (encoding == PayloadEncoding::MSGPACK) {
+        // A MessagePack string, so the status topic carries one format
+        StaticJsonDocument<16> doc;
+        doc.set(status);
+        publishJson(topic(DeviceTopic::STATUS), doc, true);
+    } else {
+        publish(topic(DeviceTopic::STATUS), status, strlen(status), true);
+    }
+}
+
 void MQTTManager::publishStatus(const String& status) {
-    String topic = baseTopic + "/status";
-    publish(topic, status, true);
+    publishStatus(status.c_str());
 }
 
 void MQTTManager::publishConfig(const String& config) {
-    String topic = baseTopic + "/config";
-    publish(topic, config, true);
+    publish(topic(DeviceTopic::CONFIG), config.c_str(), config.length(), true);
 }
 
 void MQTTManager::publishSignalStrength(int rssi) {
-    String topic = baseTopic + "/signal/strenght";
-    publish(topic, String(rssi), false);
+    publishValue(topic(DeviceTopic::SIGNAL_STRENGTH), rssi, false);
+}
+
+void MQTTManager::connectTaskFunction(void* parameter) {
+    MQTTManager* instance = static_cast<MQTTManager*>(parameter);
+    
+    while (true) {
+        // Woken by loop() once the backoff has expired
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        bool connected = instance->runConnect();
+        instance->connectState.store(connected ? ConnectState::CONNECTED : ConnectState::FAILED);
+    }
 }
 
-bool MQTTManager::reconnect() {
-    Serial.print("Attempting MQTT connection...");
+bool MQTTManager::runConnect() {
+    Serial.println("Attempting MQTT connection to " + mqttServer + "...");
+    
+    IPAddress address;
+    if (!WiFi.hostByName(mqttServer.c_str(), address)) {
+        Serial.println("ERROR: Could not resolve MQTT broker " + mqttServer);
+        return false;
+    }
+    
+    connectState.store(ConnectState::OPENING);
+    if (!wifiClient.connect(address, mqttPort, CONNECT_TIMEOUT_MS)) {
+        Serial.println("ERROR: MQTT broker unreachable");
+        return false;
+    }
     
+    // The socket is already open, so PubSubClient only sends CONNECT and
+    // waits for CONNACK (bounded by its socket timeout)
+    connectState.store(ConnectState::HANDSHAKE);
     bool connected = false;
     if (mqttUser.length() > 0) {
         connected = mqttClient->connect(clientId.c_str(), mqttUser.c_str(), mqttPassword.c_str());
     } else {
         connected = mqttClient->connect(clientId.c_str());
     }
+    if (!connected) {
+        Serial.println("ERROR: MQTT connect failed, rc=" + String(mqttClient->state()));
+        return false;
+    }
     
-    if (connected) {
-        Serial.println("connected");
-        
-        // Subscribe to command topics
-        subscribe(baseTopic + "/cmd/#");
-        subscribe(baseTopic + "/config/set");
-        
-        // Publish online status
-        publishStatus("online");
-        
-        return true;
-    } else {
-        Serial.print("failed, rc=");
-        Serial.print(mqttClient->state());
-        Serial.println(" will try again in 5 seconds");
+    // Command topics. SUBACKs are handled by PubSubClient in loop().
+    connectState.store(ConnectState::SUBSCRIBING);
+    if (!mqttClient->subscribe((baseTopic + "/cmd/#").c_str()) ||
+        !mqttClient->subscribe((baseTopic + "/config/set").c_str())) {
+        Serial.println("ERROR: MQTT subscribe failed");
+        mqttClient->disconnect();
         return false;
     }
+    
+    Serial.println("MQTT connected");
+    return true;
 }
 
-void MQTTManager::callback(char* topic, byte* payload, unsigned int length) {
-    String topicStr = String(topic);
-    String payloadStr = "";
-    
-    for (unsigned int i = 0; i < length; i++) {
-        payloadStr += (char)payload[i];
+void MQTTManager::scheduleReconnect() {
+    // Equal jitter: half of the backoff window is fixed, the other half random
+    uint32_t window = RECONNECT_BACKOFF_MAX_MS;
+    if (connectFailures < 16 && (RECONNECT_BACKOFF_MIN_MS << connectFailures) < window) {
+        window = RECONNECT_BACKOFF_MIN_MS << connectFailures;
     }
+    uint32_t wait = window / 2 + random(window / 2 + 1);
+    
+    nextConnectAttempt = millis() + wait;
+    announced = false;
+    connectState.store(ConnectState::WAITING);
     
+    Serial.println("MQTT reconnect in " + String(wait) + " ms");
+}
+
+bool MQTTManager::clientReady() {
+    // Only the owner may call this; during an attempt the client belongs to
+    // the connect task
+    return connectState.load() == ConnectState::CONNECTED && mqttClient->connected();
+}
+
+void MQTTManager::callback(char* topic, byte* payload, unsigned int length) {
     Serial.print("Message arrived [");
-    Serial.print(topicStr);
+    Serial.print(topic);
     Serial.print("]: ");
-    Serial.println(payloadStr);
+    Serial.write(payload, length);
+    Serial.println();
+    
+    // The client builds outgoing packets in the buffer this message arrived
+    // in, so a handler that publishes (queue drain or streamed document)
+    // would overwrite its own topic, payload and captures. Handlers get a
+    // copy that stays intact for the whole call; no allocation.
+    char* payloadCopy = copyInboundMessage(inboundBuffer, sizeof(inboundBuffer), topic, payload, length);
+    if (!payloadCopy) {
+        Serial.println("ERROR: Incoming message too large");
+        return;
+    }
+    
+    if (router.dispatch(inboundBuffer, payloadCopy, length)) {
+        return;
+    }
     
     if (messageCallback) {
-        messageCallback(topicStr, payloadStr);
+        messageCallback(inboundBuffer, reinterpret_cast<const uint8_t*>(payloadCopy), length);
+    } else {
+        Serial.print("WARNING: No handler for ");
+        Serial.println(inboundBuffer);
     }
 }
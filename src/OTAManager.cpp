@@ -27,21 +27,30 @@ void OTAManager::setStatusCallback(OTAStatusCallback callback) {
     statusCallback = callback;
 }
 
-void OTAManager::publishStatus(const String& status) {
+void OTAManager::publishStatus(const JsonDocument& doc) {
     if (statusCallback) {
-        statusCallback(status);
+        statusCallback(doc);
     }
-    Serial.println("OTA Status: " + status);
+    Serial.print("OTA Status: ");
+    serializeJson(doc, Serial);
+    Serial.println();
 }
 
-void OTAManager::publishProgress(int progress) {
+void OTAManager::publishStatus(const char* status, const char* message) {
     StaticJsonDocument<128> doc;
+    doc["status"] = status;
+    if (message != nullptr) {
+        doc["message"] = message;
+    }
+    publishStatus(doc);
+}
+
+void OTAManager::publishProgress(int progress) {
+    // Sent for every percent of the download, so kept off the heap
+    StaticJsonDocument<64> doc;
     doc["progress"] = progress;
     doc["status"] = "updating";
-    
-    String output;
-    serializeJson(doc, output);
-    publishStatus(output);
+    publishStatus(doc);
 }
 
 bool OTAManager::verifyIntegrity(const String& integrity) {
@@ -50,18 +59,18 @@ bool OTAManager::verifyIntegrity(const String& integrity) {
     return true;
 }
 
-void OTAManager::handleUpdateCommand(const String& payload) {
+void OTAManager::handleUpdateCommand(const char* payload, size_t length, PayloadEncoding encoding) {
     if (updateInProgress) {
-        publishStatus("{\"status\":\"error\",\"message\":\"Update already in progress\"}");
+        publishStatus("error", "Update already in progress");
         return;
     }
     
-    // Parse JSON payload
+    // Parse JSON (or MessagePack) payload
     StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, payload);
+    DeserializationError error = decodePayload(encoding, doc, payload, length);
     
     if (error) {
-        publishStatus("{\"status\":\"error\",\"message\":\"Invalid JSON payload\"}");
+        publishStatus("error", "Invalid JSON payload");
         Serial.print("JSON parsing failed: ");
         Serial.println(error.c_str());
         return;
@@ -73,7 +82,7 @@ void OTAManager::handleUpdateCommand(const String& payload) {
     String url = doc["url"] | "";
     
     if (version.isEmpty() || url.isEmpty()) {
-        publishStatus("{\"status\":\"error\",\"message\":\"Missing required fields: version and url\"}");
+        publishStatus("error", "Missing required fields: version and url");
         return;
     }
     
@@ -95,9 +104,7 @@ void OTAManager::handleUpdateCommand(const String& payload) {
     StaticJsonDocument<256> statusDoc;
     statusDoc["status"] = "starting";
     statusDoc["version"] = version;
-    String statusOutput;
-    serializeJson(statusDoc, statusOutput);
-    publishStatus(statusOutput);
+    publishStatus(statusDoc);
     
     // Configure HTTPUpdate
     WiFiClient client;
@@ -119,12 +126,12 @@ void OTAManager::handleUpdateCommand(const String& payload) {
     // Set up callbacks for start and end
     httpUpdate.onStart([this]() {
         Serial.println("\nOTA Update Started");
-        publishStatus("{\"status\":\"downloading\"}");
+        publishStatus("downloading");
     });
     
     httpUpdate.onEnd([this]() {
         Serial.println("\nOTA Update Completed Successfully");
-        publishStatus("{\"status\":\"success\",\"message\":\"Update completed, rebooting...\"}");
+        publishStatus("success", "Update completed, rebooting...");
     });
     
     httpUpdate.onError([this](int error) {
@@ -135,10 +142,7 @@ void OTAManager::handleUpdateCommand(const String& payload) {
         errorDoc["status"] = "error";
         errorDoc["error_code"] = error;
         errorDoc["message"] = errorMsg;
-        
-        String errorOutput;
-        serializeJson(errorDoc, errorOutput);
-        publishStatus(errorOutput);
+        publishStatus(errorDoc);
         
         updateInProgress = false;
     });
@@ -167,7 +171,7 @@ void OTAManager::handleUpdateCommand(const String& payload) {
             break;
         
         case HTTP_UPDATE_NO_UPDATES:
-            publishStatus("{\"status\":\"info\",\"message\":\"No updates available\"}");
+            publishStatus("info", "No updates available");
             Serial.println("No updates available");
             updateInProgress = false;
             break;
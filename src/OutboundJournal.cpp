@@ -0,0 +1,234 @@
+#include "OutboundJournal.h"
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+static_assert(MQTT_JOURNAL_SEGMENTS >= 2, "The MQTT journal needs a segment to write and one to replay");
+
+static const char* JOURNAL_DIR = "/mqttj";
+
+OutboundJournal::OutboundJournal()
+    : mounted(false), readSegment(0), nextSegment(0), writerBytes(0),
+      readOffset(0), peekedEnd(0),
+      appendedCount(0), replayedCount(0), droppedSegments(0), writeErrors(0) {
+}
+
+bool OutboundJournal::begin() {
+    if (mounted) {
+        return true;
+    }
+    
+    if (!LittleFS.begin(true)) {
+        Serial.println("ERROR: Failed to mount LittleFS for the MQTT journal");
+        return false;
+    }
+    LittleFS.mkdir(JOURNAL_DIR);
+    
+    // Segment numbers only grow, so the surviving files are the range
+    // [lowest, highest]. Appending always starts a new segment: the last one
+    // may end in a torn record.
+    bool found = false;
+    uint32_t lowest = 0;
+    uint32_t highest = 0;
+    File dir = LittleFS.open(JOURNAL_DIR);
+    if (dir) {
+        File entry = dir.openNextFile();
+        while (entry) {
+            const char* name = strrchr(entry.name(), '/');
+            name = (name != nullptr) ? name + 1 : entry.name();
+            
+            char* end;
+            uint32_t segment = strtoul(name, &end, 10);
+            if (end != name && strcmp(end, ".log") == 0) {
+                lowest = found ? std::min(lowest, segment) : segment;
+                highest = found ? std::max(highest, segment) : segment;
+                found = true;
+            }
+            entry = dir.openNextFile();
+        }
+    }
+    
+    readSegment = found ? lowest : 0;
+    nextSegment = found ? highest + 1 : 0;
+    mounted = true;
+    
+    if (pending()) {
+        Serial.println("MQTT journal: " + String(nextSegment - readSegment) + " segment(s) to replay");
+    }
+    return true;
+}
+
+bool OutboundJournal::append(const char* topic, const uint8_t* payload, size_t payloadLength, bool retained) {
+    if (!mounted) {
+        return false;
+    }
+    
+    size_t topicLength = strlen(topic);
+    if (topicLength > UINT16_MAX || payloadLength > UINT16_MAX) {
+        writeErrors++;
+        return false;
+    }
+    
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.topicLength = (uint16_t)topicLength;
+    header.payloadLength = (uint16_t)payloadLength;
+    header.flags = retained ? 0x1 : 0x0;
+    header.reserved = 0;
+    header.crc = recordCrc(header, reinterpret_cast<const uint8_t*>(topic), payload);
+    
+    size_t recordBytes = sizeof(header) + topicLength + payloadLength;
+    if (writer && writerBytes + recordBytes > MQTT_JOURNAL_SEGMENT_BYTES) {
+        closeWriter();
+    }
+    if (!writer && !openWriter()) {
+        writeErrors++;
+        return false;
+    }
+    
+    // Replay may have moved the shared position
+    writer.seek(writerBytes);
+    size_t written = writer.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    written += writer.write(reinterpret_cast<const uint8_t*>(topic), topicLength);
+    written += writer.write(payload, payloadLength);
+    if (written != recordBytes) {
+        // Whatever part made it to flash fails its CRC and ends the segment
+        Serial.println("ERROR: MQTT journal write failed");
+        closeWriter();
+        writeErrors++;
+        return false;
+    }
+    
+    writerBytes += recordBytes;
+    appendedCount++;
+    return true;
+}
+
+void OutboundJournal::flush() {
+    if (writer) {
+        writer.flush();
+    }
+}
+
+bool OutboundJournal::peek(Record& record, uint8_t* buffer, size_t bufferSize) {
+    while (pending()) {
+        // The segment being written is read through the writer's handle
+        bool live = writer && readSegment == nextSegment - 1;
+        if (live) {
+            writer.flush();
+        } else if (!reader) {
+            char path[32];
+            segmentPath(readSegment, path, sizeof(path));
+            reader = LittleFS.open(path, "r");
+            if (!reader) {
+                readSegment++;
+                readOffset = 0;
+                continue;
+            }
+        }
+        File& source = live ? writer : reader;
+        
+        RecordHeader header;
+        source.seek(readOffset);
+        if (source.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+            header.magic == RECORD_MAGIC &&
+            (size_t)header.topicLength + 1 + header.payloadLength <= bufferSize) {
+            // Laid out like a queue slot: topic, NUL, payload
+            uint8_t* topic = buffer;
+            uint8_t* payload = buffer + header.topicLength + 1;
+            if (source.read(topic, header.topicLength) == header.topicLength &&
+                source.read(payload, header.payloadLength) == header.payloadLength &&
+                recordCrc(header, topic, payload) == header.crc) {
+                topic[header.topicLength] = '\0';
+                record.topic = reinterpret_cast<const char*>(topic);
+                record.payload = payload;
+                record.payloadLength = header.payloadLength;
+                record.retained = header.flags & 0x1;
+                peekedEnd = readOffset + sizeof(header) + header.topicLength + header.payloadLength;
+                return true;
+            }
+        }
+        
+        // End of the segment, or a record torn by a power loss. A bad record
+        // in the live segment ends it for the writer too.
+        if (live) {
+            closeWriter();
+        }
+        finishReadSegment();
+    }
+    return false;
+}
+
+void OutboundJournal::consume() {
+    readOffset = peekedEnd;
+    replayedCount++;
+    
+    // Caught up with the segment being written: empty it in place, so it
+    // keeps its number and a restart does not send its records again
+    if (writer && readSegment == nextSegment - 1 && readOffset >= writerBytes) {
+        char path[32];
+        segmentPath(readSegment, path, sizeof(path));
+        closeWriter();
+        writer = LittleFS.open(path, "w+");
+        writerBytes = 0;
+        readOffset = 0;
+    }
+}
+
+JournalStats OutboundJournal::getStats() const {
+    JournalStats stats;
+    stats.segments = mounted ? nextSegment - readSegment : 0;
+    stats.appended = appendedCount;
+    stats.replayed = replayedCount;
+    stats.droppedSegments = droppedSegments;
+    stats.writeErrors = writeErrors;
+    return stats;
+}
+
+void OutboundJournal::segmentPath(uint32_t segment, char* path, size_t size) {
+    snprintf(path, size, "%s/%08lu.log", JOURNAL_DIR, (unsigned long)segment);
+}
+
+uint32_t OutboundJournal::recordCrc(const RecordHeader& header, const uint8_t* topic, const uint8_t* payload) {
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&header), offsetof(RecordHeader, crc));
+    crc = esp_rom_crc32_le(crc, topic, header.topicLength);
+    return esp_rom_crc32_le(crc, payload, header.payloadLength);
+}
+
+bool OutboundJournal::openWriter() {
+    // Capacity cap: make room by dropping the oldest segment
+    while (nextSegment - readSegment >= MQTT_JOURNAL_SEGMENTS) {
+        finishReadSegment();
+        droppedSegments++;
+        Serial.println("WARNING: MQTT journal full, oldest segment dropped");
+    }
+    
+    char path[32];
+    segmentPath(nextSegment, path, sizeof(path));
+    writer = LittleFS.open(path, "w+");
+    if (!writer) {
+        Serial.println("ERROR: Failed to create MQTT journal segment " + String(path));
+        return false;
+    }
+    
+    nextSegment++;
+    writerBytes = 0;
+    return true;
+}
+
+void OutboundJournal::closeWriter() {
+    writer.close();
+    writer = File();
+}
+
+void OutboundJournal::finishReadSegment() {
+    if (reader) {
+        reader.close();
+        reader = File();
+    }
+    
+    char path[32];
+    segmentPath(readSegment, path, sizeof(path));
+    LittleFS.remove(path);
+    readSegment++;
+    readOffset = 0;
+}
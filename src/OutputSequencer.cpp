@@ -0,0 +1,249 @@
+#include "OutputSequencer.h"
+#include "GpioPort.h"
+
+// Steps due within this window are applied in the same timer callback
+static const int64_t SEQUENCER_SLACK_US = 20;
+
+// Shortest delay handed to esp_timer
+static const int64_t SEQUENCER_MIN_ARM_US = 10;
+
+OutputSequencer::OutputSequencer() : timer(nullptr), armTicket(0) {
+    memset(sequences, 0, sizeof(sequences));
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+OutputSequencer::~OutputSequencer() {
+    if (timer != nullptr) {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+}
+
+bool OutputSequencer::begin() {
+    esp_timer_create_args_t args = {};
+    args.callback = timerCallback;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "IOSequencer";
+    
+    if (esp_timer_create(&args, &timer) != ESP_OK) {
+        Serial.println("ERROR: Failed to create sequencer timer");
+        timer = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void OutputSequencer::setDoneCallback(SequenceDoneCallback callback) {
+    doneCallback = callback;
+}
+
+bool OutputSequencer::start(uint64_t pinMask, const WaveformStep* steps, uint8_t stepCount,
+                            uint32_t repeat, uint8_t idleLevel) {
+    if (timer == nullptr || pinMask == 0 || steps == nullptr ||
+        stepCount == 0 || stepCount > MAX_STEPS) {
+        return false;
+    }
+    
+    // Zero-length steps would let an endless waveform spin the timer task
+    for (uint8_t i = 0; i < stepCount; i++) {
+        if (steps[i].durationUs == 0) {
+            return false;
+        }
+    }
+    
+    bool started = false;
+    int64_t next = INT64_MAX;
+    uint32_t ticket = 0;
+    
+    portENTER_CRITICAL(&lock);
+    cancelLocked(pinMask);
+    
+    for (uint8_t i = 0; i < MAX_SEQUENCES; i++) {
+        Sequence& seq = sequences[i];
+        if (seq.active) {
+            continue;
+        }
+        
+        seq.pinMask = pinMask;
+        memcpy(seq.steps, steps, stepCount * sizeof(WaveformStep));
+        seq.stepCount = stepCount;
+        seq.currentStep = 0;
+        seq.repeat = repeat;
+        seq.iteration = 0;
+        seq.idleLevel = idleLevel ? HIGH : LOW;
+        
+        int64_t now = esp_timer_get_time();
+        writePins(pinMask, steps[0].level);
+        seq.nextUs = now + steps[0].durationUs;
+        seq.active = true;
+        
+        next = nextDeadlineLocked(ticket);
+        started = true;
+        break;
+    }
+    portEXIT_CRITICAL(&lock);
+    
+    if (!started) {
+        Serial.println("ERROR: No free output sequence slot");
+        return false;
+    }
+    
+    if (!arm(next, ticket)) {
+        // Nothing would ever end the sequence, so undo it
+        portENTER_CRITICAL(&lock);
+        cancelLocked(pinMask);
+        writePins(pinMask, idleLevel ? HIGH : LOW);
+        portEXIT_CRITICAL(&lock);
+        return false;
+    }
+    return true;
+}
+
+bool OutputSequencer::pulse(uint8_t pin, uint32_t widthUs) {
+    WaveformStep step = {HIGH, widthUs};
+    return start(1ULL << pin, &step, 1, 1, LOW);
+}
+
+void OutputSequencer::cancel(uint64_t pinMask) {
+    uint32_t ticket;
+    
+    portENTER_CRITICAL(&lock);
+    cancelLocked(pinMask);
+    int64_t next = nextDeadlineLocked(ticket);
+    portEXIT_CRITICAL(&lock);
+    
+    arm(next, ticket);
+}
+
+bool OutputSequencer::isBusy(uint8_t pin) {
+    uint64_t bit = 1ULL << pin;
+    bool busy = false;
+    
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < MAX_SEQUENCES; i++) {
+        if (sequences[i].active && (sequences[i].pinMask & bit)) {
+            busy = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    
+    return busy;
+}
+
+void OutputSequencer::timerCallback(void* arg) {
+    static_cast<OutputSequencer*>(arg)->service();
+}
+
+void OutputSequencer::service() {
+    struct Finished {
+        uint64_t pinMask;
+        uint8_t level;
+    };
+    Finished finished[MAX_SEQUENCES];
+    uint8_t finishedCount = 0;
+    uint32_t ticket;
+    
+    portENTER_CRITICAL(&lock);
+    int64_t now = esp_timer_get_time();
+    
+    for (uint8_t i = 0; i < MAX_SEQUENCES; i++) {
+        Sequence& seq = sequences[i];
+        
+        // Apply every transition that is due; short steps may have piled up
+        while (seq.active && seq.nextUs <= now + SEQUENCER_SLACK_US) {
+            seq.currentStep++;
+            if (seq.currentStep >= seq.stepCount) {
+                seq.currentStep = 0;
+                seq.iteration++;
+                
+                if (seq.repeat != 0 && seq.iteration >= seq.repeat) {
+                    writePins(seq.pinMask, seq.idleLevel);
+                    seq.active = false;
+                    finished[finishedCount++] = {seq.pinMask, seq.idleLevel};
+                    break;
+                }
+            }
+            
+            writePins(seq.pinMask, seq.steps[seq.currentStep].level);
+            seq.nextUs += seq.steps[seq.currentStep].durationUs;
+        }
+    }
+    
+    int64_t next = nextDeadlineLocked(ticket);
+    portEXIT_CRITICAL(&lock);
+    
+    arm(next, ticket);
+    
+    // Report outside the lock so the callback may queue or publish freely
+    if (doneCallback) {
+        for (uint8_t i = 0; i < finishedCount; i++) {
+            doneCallback(finished[i].pinMask, finished[i].level);
+        }
+    }
+}
+
+int64_t OutputSequencer::nextDeadlineLocked(uint32_t& ticket) {
+    int64_t next = INT64_MAX;
+    for (uint8_t i = 0; i < MAX_SEQUENCES; i++) {
+        if (sequences[i].active && sequences[i].nextUs < next) {
+            next = sequences[i].nextUs;
+        }
+    }
+    
+    ticket = ++armTicket;
+    return next;
+}
+
+bool OutputSequencer::arm(int64_t next, uint32_t ticket) {
+    if (timer == nullptr) {
+        return false;
+    }
+    
+    // Several tasks may arm at once. Whoever picked the newest deadline has
+    // the newest ticket; anyone else, or a start that lost the race with
+    // another start (ESP_ERR_INVALID_STATE), picks the deadline again and
+    // re-arms. Any other error would repeat forever, so it is reported.
+    while (true) {
+        esp_timer_stop(timer);
+        
+        esp_err_t result = ESP_OK;
+        if (next != INT64_MAX) {
+            int64_t delay = next - esp_timer_get_time();
+            if (delay < SEQUENCER_MIN_ARM_US) {
+                delay = SEQUENCER_MIN_ARM_US;
+            }
+            result = esp_timer_start_once(timer, (uint64_t)delay);
+        }
+        
+        if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) {
+            Serial.println("ERROR: Failed to arm sequencer timer: " + String(esp_err_to_name(result)));
+            return false;
+        }
+        
+        portENTER_CRITICAL(&lock);
+        bool current = result == ESP_OK && ticket == armTicket;
+        if (!current) {
+            next = nextDeadlineLocked(ticket);
+        }
+        portEXIT_CRITICAL(&lock);
+        
+        if (current) {
+            return true;
+        }
+    }
+}
+
+void OutputSequencer::cancelLocked(uint64_t pinMask) {
+    for (uint8_t i = 0; i < MAX_SEQUENCES; i++) {
+        if (sequences[i].active && (sequences[i].pinMask & pinMask)) {
+            sequences[i].active = false;
+        }
+    }
+}
+
+void OutputSequencer::writePins(uint64_t pinMask, uint8_t level) {
+    // All pins of a sequence switch together through the set/clear registers
+    GpioPort::write(pinMask, level ? pinMask : 0);
+}
@@ -0,0 +1,180 @@
+#include "PulseCounter.h"
+
+// PCNT glitch filter in APB cycles (80 MHz): pulses shorter than ~1.25 us are
+// ignored, which still passes several hundred kHz of clean edges
+static const uint16_t COUNTER_FILTER_CYCLES = 100;
+
+PulseCounter::PulseCounter() : activeCount(0) {
+    memset(channels, 0, sizeof(channels));
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+PulseCounter::~PulseCounter() {
+    for (uint8_t unit = 0; unit < MAX_CHANNELS; unit++) {
+        if (channels[unit].active) {
+            detach(channels[unit].pin);
+        }
+    }
+}
+
+bool PulseCounter::attach(uint8_t pin, bool countRising, bool countFalling) {
+#if SOC_PCNT_SUPPORTED
+    if (findChannel(pin) >= 0) {
+        detach(pin);
+    }
+    
+    int unit = -1;
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        if (!channels[i].active) {
+            unit = i;
+            break;
+        }
+    }
+    if (unit < 0) {
+        Serial.println("ERROR: No free pulse counter unit (max " + String(MAX_CHANNELS) + ")");
+        return false;
+    }
+    
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = pin;
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.pos_mode = countRising ? PCNT_COUNT_INC : PCNT_COUNT_DIS;
+    config.neg_mode = countFalling ? PCNT_COUNT_INC : PCNT_COUNT_DIS;
+    config.counter_h_lim = COUNTER_LIMIT;
+    config.counter_l_lim = -COUNTER_LIMIT;
+    config.unit = (pcnt_unit_t)unit;
+    config.channel = PCNT_CHANNEL_0;
+    
+    if (pcnt_unit_config(&config) != ESP_OK) {
+        Serial.println("ERROR: Failed to configure pulse counter on pin " + String(pin));
+        return false;
+    }
+    
+    pcnt_set_filter_value((pcnt_unit_t)unit, COUNTER_FILTER_CYCLES);
+    pcnt_filter_enable((pcnt_unit_t)unit);
+    pcnt_counter_pause((pcnt_unit_t)unit);
+    pcnt_counter_clear((pcnt_unit_t)unit);
+    
+    portENTER_CRITICAL(&lock);
+    Channel& channel = channels[unit];
+    memset(&channel, 0, sizeof(channel));
+    channel.pin = pin;
+    channel.active = true;
+    activeCount++;
+    portEXIT_CRITICAL(&lock);
+    
+    pcnt_counter_resume((pcnt_unit_t)unit);
+    return true;
+#else
+    (void)countRising;
+    (void)countFalling;
+    Serial.println("ERROR: Pulse counting is not supported on this chip (pin " + String(pin) + ")");
+    return false;
+#endif
+}
+
+void PulseCounter::detach(uint8_t pin) {
+    int unit = findChannel(pin);
+    if (unit < 0) {
+        return;
+    }
+    
+    portENTER_CRITICAL(&lock);
+    channels[unit].active = false;
+    activeCount--;
+    portEXIT_CRITICAL(&lock);
+
+#if SOC_PCNT_SUPPORTED
+    pcnt_counter_pause((pcnt_unit_t)unit);
+    pcnt_counter_clear((pcnt_unit_t)unit);
+#endif
+}
+
+bool PulseCounter::isActive() const {
+    return activeCount > 0;
+}
+
+void PulseCounter::poll(int64_t now) {
+    for (uint8_t unit = 0; unit < MAX_CHANNELS; unit++) {
+        if (!channels[unit].active) {
+            continue;
+        }
+        
+        accumulate(unit);
+        
+        portENTER_CRITICAL(&lock);
+        Channel& channel = channels[unit];
+        channel.windowUs[channel.windowHead] = now;
+        channel.windowTotal[channel.windowHead] = channel.total;
+        channel.windowHead = (channel.windowHead + 1) % WINDOW_SAMPLES;
+        if (channel.windowCount < WINDOW_SAMPLES) {
+            channel.windowCount++;
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+}
+
+bool PulseCounter::read(uint8_t pin, int64_t now, CounterReading& reading) {
+    int unit = findChannel(pin);
+    if (unit < 0) {
+        return false;
+    }
+    
+    // Pick up pulses counted since the last poll
+    accumulate(unit);
+    
+    portENTER_CRITICAL(&lock);
+    Channel& channel = channels[unit];
+    reading.total = channel.total;
+    reading.hz = rateLocked(channel, now);
+    portEXIT_CRITICAL(&lock);
+    return true;
+}
+
+int PulseCounter::findChannel(uint8_t pin) {
+    for (uint8_t unit = 0; unit < MAX_CHANNELS; unit++) {
+        if (channels[unit].active && channels[unit].pin == pin) {
+            return unit;
+        }
+    }
+    return -1;
+}
+
+void PulseCounter::accumulate(uint8_t unit) {
+#if SOC_PCNT_SUPPORTED
+    portENTER_CRITICAL(&lock);
+    Channel& channel = channels[unit];
+    int16_t raw = 0;
+    if (channel.active && pcnt_get_counter_value((pcnt_unit_t)unit, &raw) == ESP_OK) {
+        // The unit counts 0..COUNTER_LIMIT-1 and then restarts at 0, so a
+        // backwards step means it wrapped once since the last read
+        int32_t delta = (int32_t)raw - channel.lastRaw;
+        if (delta < 0) {
+            delta += COUNTER_LIMIT;
+        }
+        channel.total += (uint32_t)delta;
+        channel.lastRaw = raw;
+    }
+    portEXIT_CRITICAL(&lock);
+#else
+    (void)unit;
+#endif
+}
+
+float PulseCounter::rateLocked(const Channel& channel, int64_t now) {
+    if (channel.windowCount == 0) {
+        return 0.0f;
+    }
+    
+    // Oldest sample still in the window
+    uint8_t oldest = (channel.windowHead + WINDOW_SAMPLES - channel.windowCount) % WINDOW_SAMPLES;
+    int64_t elapsedUs = now - channel.windowUs[oldest];
+    if (elapsedUs <= 0) {
+        return 0.0f;
+    }
+    
+    uint64_t pulses = channel.total - channel.windowTotal[oldest];
+    return (float)((double)pulses * 1000000.0 / (double)elapsedUs);
+}
@@ -0,0 +1,175 @@
+#include "RuleEngine.h"
+
+static_assert(RuleProgram::MAX_RULES <= 32, "Rule results are kept in a 32-bit mask");
+
+void RuleProgram::clear() {
+    ruleCount = 0;
+    codeLength = 0;
+    inputMask = 0;
+}
+
+bool RuleProgram::addRule(const RuleInstruction* condition, uint8_t length,
+                          const RuleAction& onTrue, const RuleAction& onFalse) {
+    if (ruleCount >= MAX_RULES || length == 0 || codeLength + length > MAX_CODE) {
+        return false;
+    }
+    
+    // Walk the stack depth the condition will need and collect its pins
+    uint8_t depth = 0;
+    uint64_t pins = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        const RuleInstruction& insn = condition[i];
+        switch (insn.op) {
+            case RuleOp::AND:
+            case RuleOp::OR:
+                if (insn.arg == 0 || insn.arg > depth) {
+                    return false;
+                }
+                depth -= insn.arg - 1;
+                break;
+            
+            case RuleOp::NOT:
+                if (depth == 0) {
+                    return false;
+                }
+                break;
+            
+            default:
+                if (insn.pin >= RuleEngine::MAX_PINS || depth >= MAX_STACK) {
+                    return false;
+                }
+                pins |= (1ULL << insn.pin);
+                depth++;
+                break;
+        }
+    }
+    if (depth != 1) {
+        return false;
+    }
+    
+    Rule& rule = rules[ruleCount++];
+    rule.start = codeLength;
+    rule.length = length;
+    rule.onTrue = onTrue;
+    rule.onFalse = onFalse;
+    rule.pins = pins;
+    
+    for (uint8_t i = 0; i < length; i++) {
+        code[codeLength++] = condition[i];
+    }
+    inputMask |= pins;
+    return true;
+}
+
+RuleEngine::RuleEngine() : results(0), loadedVersion(0) {
+    for (uint8_t i = 0; i < MAX_PINS; i++) {
+        values[i] = -1;
+    }
+}
+
+void RuleEngine::setValue(uint8_t pin, int32_t value) {
+    if (pin < MAX_PINS) {
+        values[pin] = value;
+    }
+}
+
+void RuleEngine::reset(const RuleProgram& program) {
+    results = 0;
+    bool edge;
+    for (uint8_t i = 0; i < program.ruleCount; i++) {
+        if (evaluate(program, program.rules[i], NO_PIN, -1, edge)) {
+            results |= (1UL << i);
+        }
+    }
+    loadedVersion = program.version;
+}
+
+uint8_t RuleEngine::update(const RuleProgram& program, uint8_t pin, int32_t value,
+                           RuleAction* fired, uint8_t maxFired) {
+    if (pin >= MAX_PINS) {
+        return 0;
+    }
+    
+    int32_t previous = values[pin];
+    values[pin] = value;
+    
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < program.ruleCount; i++) {
+        const Rule& rule = program.rules[i];
+        if (!((rule.pins >> pin) & 0x1)) {
+            continue;
+        }
+        
+        bool edge;
+        bool result = evaluate(program, rule, pin, previous, edge);
+        bool was = (results >> i) & 0x1;
+        if (result == was && !(result && edge)) {
+            continue;
+        }
+        
+        if (result) {
+            results |= (1UL << i);
+        } else {
+            results &= ~(1UL << i);
+        }
+        
+        const RuleAction& action = result ? rule.onTrue : rule.onFalse;
+        if (action.type != RuleActionType::NONE && count < maxFired) {
+            fired[count++] = action;
+        }
+    }
+    return count;
+}
+
+bool RuleEngine::evaluate(const RuleProgram& program, const Rule& rule, uint8_t pin, int32_t previous, bool& edge) const {
+    bool stack[RuleProgram::MAX_STACK];
+    uint8_t depth = 0;
+    edge = false;
+    
+    for (uint16_t i = rule.start; i < rule.start + rule.length; i++) {
+        const RuleInstruction& insn = program.code[i];
+        int32_t current = (insn.pin < MAX_PINS) ? values[insn.pin] : -1;
+        bool event = (insn.pin == pin);     // Edges only exist for the pin being updated
+        
+        switch (insn.op) {
+            case RuleOp::LEVEL:
+                stack[depth++] = current >= 0 && (current != 0) == (insn.arg != 0);
+                break;
+            case RuleOp::ROSE:
+                stack[depth++] = event && previous == 0 && current > 0;
+                edge = edge || stack[depth - 1];
+                break;
+            case RuleOp::FELL:
+                stack[depth++] = event && previous > 0 && current == 0;
+                edge = edge || stack[depth - 1];
+                break;
+            case RuleOp::CHANGED:
+                stack[depth++] = event && previous >= 0 && previous != current;
+                edge = edge || stack[depth - 1];
+                break;
+            case RuleOp::ABOVE:
+                stack[depth++] = current >= 0 && current > insn.arg;
+                break;
+            case RuleOp::BELOW:
+                stack[depth++] = current >= 0 && current < insn.arg;
+                break;
+            case RuleOp::AND:
+            case RuleOp::OR: {
+                // addRule() guarantees arg entries are on the stack
+                bool all = true;
+                bool any = false;
+                for (uint16_t n = 0; n < insn.arg; n++) {
+                    bool entry = stack[--depth];
+                    all = all && entry;
+                    any = any || entry;
+                }
+                stack[depth++] = (insn.op == RuleOp::AND) ? all : any;
+                break;
+            }
+            case RuleOp::NOT:
+                stack[depth - 1] = !stack[depth - 1];
+                break;
+        }
+    }
+    return stack[0];
+}
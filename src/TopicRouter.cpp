@@ -0,0 +1,201 @@
+#include "TopicRouter.h"
+#include <cstring>
+
+static_assert(TopicRouter::MAX_NODES < 0xFF, "Node indices are 8-bit with 0xFF as none");
+static_assert(TopicRouter::MAX_ROUTES <= 127, "Route indices are int8_t");
+
+TopicRouter::TopicRouter() : nodeCount(1), labelTop(0), routeCount(0) {
+    // Node 0 is the root, standing for the position before the first level
+    nodes[0] = {NodeKind::LITERAL, 0, 0, NONE, NONE, -1};
+}
+
+bool TopicRouter::on(const char* pattern, TopicHandler handler) {
+    if (routeCount >= MAX_ROUTES || pattern == nullptr || *pattern == '\0') {
+        return false;
+    }
+    
+    uint8_t node = 0;
+    uint8_t captures = 0;
+    const char* level = pattern;
+    
+    while (true) {
+        const char* end = strchr(level, '/');
+        size_t length = (end != nullptr) ? (size_t)(end - level) : strlen(level);
+        
+        NodeKind kind = NodeKind::LITERAL;
+        if (length == 1 && *level == '+') {
+            kind = NodeKind::ANY_LEVEL;
+        } else if (length == 1 && *level == '#') {
+            if (end != nullptr) {
+                return false;   // '#' must be the last level
+            }
+            kind = NodeKind::ANY_REST;
+        } else if (length >= 2 && level[0] == '{' && level[length - 1] == '}') {
+            kind = NodeKind::NUMBER;
+        } else {
+            for (size_t i = 0; i < length; i++) {
+                if (strchr("+#{}", level[i]) != nullptr) {
+                    return false;
+                }
+            }
+        }
+        
+        if (kind != NodeKind::LITERAL && ++captures > TopicMatch::MAX_CAPTURES) {
+            return false;
+        }
+        
+        node = findOrAddChild(node, kind, level, length);
+        if (node == NONE) {
+            return false;
+        }
+        
+        if (end == nullptr) {
+            break;
+        }
+        level = end + 1;
+    }
+    
+    if (nodes[node].route >= 0) {
+        return false;
+    }
+    
+    nodes[node].route = (int8_t)routeCount;
+    handlers[routeCount++] = handler;
+    return true;
+}
+
+bool TopicRouter::dispatch(const char* topic, const char* payload, size_t length) const {
+    TopicMatch result;
+    int8_t route = match(topic, result);
+    if (route < 0) {
+        return false;
+    }
+    
+    handlers[route](result, payload, length);
+    return true;
+}
+
+int8_t TopicRouter::match(const char* topic, TopicMatch& result) const {
+    result.count = 0;
+    int8_t route = -1;
+    if (topic == nullptr || !matchLevel(0, topic, result, route)) {
+        return -1;
+    }
+    return route;
+}
+
+uint8_t TopicRouter::findOrAddChild(uint8_t parent, NodeKind kind, const char* label, size_t length) {
+    uint8_t last = NONE;
+    for (uint8_t child = nodes[parent].firstChild; child != NONE; child = nodes[child].nextSibling) {
+        const Node& node = nodes[child];
+        if (node.kind == kind &&
+            (kind != NodeKind::LITERAL ||
+             (node.labelLength == length && memcmp(&labels[node.label], label, length) == 0))) {
+            return child;
+        }
+        last = child;
+    }
+    
+    if (nodeCount >= MAX_NODES || length > 0xFF) {
+        return NONE;
+    }
+    
+    Node node = {kind, 0, 0, NONE, NONE, -1};
+    if (kind == NodeKind::LITERAL) {
+        if (labelTop + length > LABEL_BYTES) {
+            return NONE;
+        }
+        memcpy(&labels[labelTop], label, length);
+        node.label = labelTop;
+        node.labelLength = (uint8_t)length;
+        labelTop += length;
+    }
+    
+    uint8_t index = nodeCount++;
+    nodes[index] = node;
+    
+    // Literals go in front of captures and wildcards so they are tried first
+    if (kind == NodeKind::LITERAL || last == NONE) {
+        nodes[index].nextSibling = nodes[parent].firstChild;
+        nodes[parent].firstChild = index;
+    } else {
+        nodes[last].nextSibling = index;
+    }
+    return index;
+}
+
+bool TopicRouter::matchLevel(uint8_t parent, const char* level, TopicMatch& result, int8_t& route) const {
+    // Literals are compared in place; the level is only scanned (and parsed
+    // as a number) once a capture needs it
+    const char* end = nullptr;
+    uint32_t value = 0;
+    bool numeric = true;
+    
+    for (uint8_t child = nodes[parent].firstChild; child != NONE; child = nodes[child].nextSibling) {
+        const Node& node = nodes[child];
+        uint8_t captures = result.count;
+        const char* next;
+        
+        if (node.kind == NodeKind::LITERAL) {
+            const char* label = &labels[node.label];
+            if (*label != *level || strncmp(label, level, node.labelLength) != 0) {
+                continue;
+            }
+            next = level + node.labelLength;
+            if (*next != '/' && *next != '\0') {
+                continue;
+            }
+        } else {
+            if (end == nullptr) {
+                end = level;
+                while (*end != '\0' && *end != '/') {
+                    char c = *end;
+                    if (c < '0' || c > '9' || value > (UINT32_MAX - 9) / 10) {
+                        numeric = false;
+                    } else {
+                        value = value * 10 + (uint32_t)(c - '0');
+                    }
+                    end++;
+                }
+                numeric = numeric && end != level;
+            }
+            
+            if (node.kind == NodeKind::NUMBER && !numeric) {
+                continue;
+            }
+            
+            bool rest = (node.kind == NodeKind::ANY_REST);
+            result.captureStart[result.count] = level;
+            result.captureLength[result.count] = (uint16_t)(rest ? strlen(level) : (size_t)(end - level));
+            result.captureValue[result.count++] = (node.kind == NodeKind::NUMBER) ? value : 0;
+            if (rest) {
+                route = node.route;
+                return true;
+            }
+            next = end;
+        }
+        
+        if (*next == '\0') {
+            if (node.route >= 0) {
+                route = node.route;
+                return true;
+            }
+            
+            // As in MQTT, a trailing '#' also matches its parent level
+            // ("a/#" matches "a"), with an empty capture
+            for (uint8_t rest = node.firstChild; rest != NONE; rest = nodes[rest].nextSibling) {
+                if (nodes[rest].kind == NodeKind::ANY_REST && nodes[rest].route >= 0) {
+                    result.captureStart[result.count] = next;
+                    result.captureLength[result.count] = 0;
+                    result.captureValue[result.count++] = 0;
+                    route = nodes[rest].route;
+                    return true;
+                }
+            }
+        } else if (matchLevel(child, next + 1, result, route)) {
+            return true;
+        }
+        result.count = captures;
+    }
+    return false;
+}
@@ -4,6 +4,7 @@
 #include "OTAManager.h"
 #include "InputManager.h"
 #include <ArduinoJson.h>
+#include <esp_wifi.h>
 
 // Manager instances
 WiFiManager wifiManager;
@@ -19,11 +20,11 @@ const unsigned long STATUS_INTERVAL = 30000; // 30 seconds
 unsigned long lastSignalUpdate = 0;
 const unsigned long SIGNAL_INTERVAL = 10000; // 10 seconds
 
-void handleMQTTMessage(String topic, String payload);
+void registerCommands();
 void publishDeviceInfo();
 void publishSignalStrength();
-void handleConfigCommand(const String& payload);
-void publishOTAStatus(const String& status);
+void handleConfigCommand(const char* payload, size_t length);
+void publishOTAStatus(const JsonDocument& status);
 
 void setup() {
     Serial.begin(115200);
@@ -41,7 +42,7 @@ void setup() {
     if (wifiManager.isConnected()) {
         Serial.println("Initializing MQTT...");
         mqttManager.begin();
-        mqttManager.setCallback(handleMQTTMessage);
+        registerCommands();
         
         // Initialize OTA with callback for status publishing
         Serial.println("Initializing OTA...");
@@ -94,126 +95,28 @@ void loop() {
     }
 }
 
-void handleMQTTMessage(String topic, String payload) {
-    Serial.print("Processing message: ");
-    Serial.print(topic);
-    Serial.print(" = ");
-    Serial.println(payload);
+void registerCommands() {
+    // Device-level commands; the managers register their own
+    mqttManager.on("config/set", [](const TopicMatch&, const char* payload, size_t length) {
+        handleConfigCommand(payload, length);
+    });
     
-    // Handle configuration updates
-    if (topic.endsWith("/config/set")) {
-        handleConfigCommand(payload);
-    }
-    // Handle MQTT broker configuration
-    else if (topic.endsWith("/cmd/mqtt")) {
-        StaticJsonDocument<256> doc;
-        DeserializationError error = deserializeJson(doc, payload);
-        
-        if (!error) {
-            String server = doc["server"] | "";
-            int port = doc["port"] | 1883;
-            String user = doc["user"] | "";
-            String password = doc["password"] | "";
-            
-            if (server.length() > 0) {
-                mqttManager.saveConfig(server, port, user, password);
-                mqttManager.publishStatus("mqtt_config_updated");
-                Serial.println("MQTT configuration updated via MQTT");
-            }
-        }
-    }
-    // Handle OTA update command
-    else if (topic.endsWith("/cmd/ota_update")) {
-        otaManager.handleUpdateCommand(payload);
-    }
-    // Handle restart command
-    else if (topic.endsWith("/cmd/restart")) {
+    mqttManager.on("cmd/ota_update", [](const TopicMatch&, const char* payload, size_t length) {
+        otaManager.handleUpdateCommand(payload, length, mqttManager.getEncoding());
+    });
+    
+    mqttManager.on("cmd/restart", [](const TopicMatch&, const char*, size_t) {
         mqttManager.publishStatus("restarting");
         delay(1000);
         ESP.restart();
-    }
-    // Handle WiFi reset command
-    else if (topic.endsWith("/cmd/reset_wifi")) {
+    });
+    
+    mqttManager.on("cmd/reset_wifi", [](const TopicMatch&, const char*, size_t) {
         wifiManager.clearCredentials();
         mqttManager.publishStatus("wifi_reset");
         delay(1000);
         ESP.restart();
-    }
-    // Handle IO configuration
-    else if (topic.endsWith("/cmd/io/config")) {
-        StaticJsonDocument<512> doc;
-        DeserializationError error = deserializeJson(doc, payload);
-        
-        if (!error) {
-            if (inputManager.configurePin(doc)) {
-                mqttManager.publishStatus("io_config_updated");
-                Serial.println("IO configuration updated via MQTT");
-            } else {
-                mqttManager.publishStatus("io_config_failed");
-                Serial.println("IO configuration failed");
-            }
-        }
-    }
-    // Handle IO exclude list
-    else if (topic.endsWith("/cmd/io/exclude")) {
-        StaticJsonDocument<512> doc;
-        DeserializationError error = deserializeJson(doc, payload);
-        
-        if (!error) {
-            std::vector<uint8_t> pins;
-            std::vector<std::pair<uint8_t, uint8_t>> ranges;
-            bool persist = doc["persist"] | false;
-            
-            JsonArray pinsArray = doc["pins"];
-            for (JsonVariant pin : pinsArray) {
-                pins.push_back(pin.as<uint8_t>());
-            }
-            
-            JsonArray rangesArray = doc["ranges"];
-            for (JsonVariant rangeVariant : rangesArray) {
-                JsonObject rangeObj = rangeVariant.as<JsonObject>();
-                uint8_t from = rangeObj["from"];
-                uint8_t to = rangeObj["to"];
-                ranges.push_back(std::make_pair(from, to));
-            }
-            
-            if (inputManager.setExcludeList(pins, ranges, persist)) {
-                mqttManager.publishStatus("io_exclude_updated");
-                Serial.println("IO exclude list updated via MQTT");
-            }
-        }
-    }
-    // Handle IO trigger - match pattern /cmd/io/{pin}/trigger
-    else if (topic.indexOf("/cmd/io/") >= 0 && topic.endsWith("/trigger")) {
-        // Extract pin number from topic
-        int startIdx = topic.indexOf("/cmd/io/") + 8;
-        int endIdx = topic.indexOf("/trigger");
-        String pinStr = topic.substring(startIdx, endIdx);
-        uint8_t pin = pinStr.toInt();
-        
-        // Parse payload for action
-        StaticJsonDocument<128> doc;
-        DeserializationError error = deserializeJson(doc, payload);
-        
-        String action;
-        uint16_t pulseWidth = 100;
-        
-        if (!error && doc.is<JsonObject>()) {
-            action = doc["action"] | "set";
-            pulseWidth = doc["pulse"] | 100;
-        } else {
-            // Payload is plain text action
-            action = payload;
-        }
-        
-        if (inputManager.triggerPin(pin, action, pulseWidth)) {
-            mqttManager.publishStatus("io_trigger_success");
-            Serial.println("IO trigger executed on pin " + String(pin));
-        } else {
-            mqttManager.publishStatus("io_trigger_failed");
-            Serial.println("IO trigger failed on pin " + String(pin));
-        }
-    }
+    });
 }
 
 void publishDeviceInfo() {
@@ -223,20 +126,49 @@ void publishDeviceInfo() {
     
     StaticJsonDocument<512> doc;
     
+    // Periodic telemetry: everything is formatted into stack buffers rather
+    // than temporary Strings
+    char deviceId[9];
+    snprintf(deviceId, sizeof(deviceId), "%lx", (unsigned long)(uint32_t)ESP.getEfuseMac());
+    
+    wifi_config_t wifiConfig;
+    char ssid[sizeof(wifiConfig.sta.ssid) + 1] = "";
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifiConfig) == ESP_OK) {
+        memcpy(ssid, wifiConfig.sta.ssid, sizeof(wifiConfig.sta.ssid));
+        ssid[sizeof(wifiConfig.sta.ssid)] = '\0';
+    }
+    
+    IPAddress ip = WiFi.localIP();
+    char ipAddress[16];
+    snprintf(ipAddress, sizeof(ipAddress), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    
     // Device information
-    doc["device_id"] = String((uint32_t)ESP.getEfuseMac(), HEX);
+    doc["device_id"] = deviceId;
     doc["uptime"] = millis() / 1000;
     doc["free_heap"] = ESP.getFreeHeap();
     doc["wifi_rssi"] = WiFi.RSSI();
-    doc["wifi_ssid"] = WiFi.SSID();
-    doc["ip_address"] = WiFi.localIP().toString();
+    doc["wifi_ssid"] = ssid;
+    doc["ip_address"] = ipAddress;
     doc["mqtt_connected"] = mqttManager.isConnected();
+    doc["encoding"] = encodingName(mqttManager.getEncoding());
     doc["ota_update_in_progress"] = otaManager.isUpdateInProgress();
+    doc["io_events_dropped"] = inputManager.getDroppedEventCount();
+    doc["io_publishes_suppressed"] = inputManager.getSuppressedPublishCount();
+    doc["io_rule_fires"] = inputManager.getRuleFireCount();
     
-    String output;
-    serializeJson(doc, output);
+    PublishQueueStats queueStats = mqttManager.getQueueStats();
+    doc["mqtt_queue_depth"] = queueStats.depth;
+    doc["mqtt_queue_high_water"] = queueStats.highWater;
+    doc["mqtt_queue_dropped"] = queueStats.dropped;
+    doc["mqtt_publish_failed"] = queueStats.failed;
+    
+    if (mqttManager.isJournalEnabled()) {
+        JournalStats journalStats = mqttManager.getJournalStats();
+        doc["mqtt_journal_segments"] = journalStats.segments;
+        doc["mqtt_journal_dropped"] = journalStats.droppedSegments;
+    }
     
-    mqttManager.publishStatus(output);
+    mqttManager.publishJson(mqttManager.topic(DeviceTopic::STATUS), doc, true);
 }
 
 void publishSignalStrength() {
@@ -248,9 +180,9 @@ void publishSignalStrength() {
     mqttManager.publishSignalStrength(rssi);
 }
 
-void handleConfigCommand(const String& payload) {
+void handleConfigCommand(const char* payload, size_t length) {
     StaticJsonDocument<256> doc;
-    DeserializationError error = deserializeJson(doc, payload);
+    DeserializationError error = mqttManager.decode(doc, payload, length);
     
     if (!error) {
         // Handle different configuration parameters
@@ -265,10 +197,10 @@ void handleConfigCommand(const String& payload) {
     }
 }
 
-void publishOTAStatus(const String& status) {
-    if (mqttManager.isConnected()) {
-        String deviceId = "ESP32-Vault-" + String((uint32_t)ESP.getEfuseMac(), HEX);
-        String topic = "esp32vault/" + deviceId + "/ota/status";
-        mqttManager.publish(topic, status);
+void publishOTAStatus(const JsonDocument& status) {
+    if (!mqttManager.isConnected()) {
+        return;
     }
+    
+    mqttManager.publishJson(mqttManager.topic(DeviceTopic::OTA_STATUS), status);
 }
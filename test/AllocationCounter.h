@@ -0,0 +1,36 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new/delete so host tests can count the heap
+// allocations a piece of code makes. Include it from the test's main file
+// only, then set 'counting' around the code under test and read
+// 'allocations'. The operators stay out of line so the compiler never pairs
+// an inlined malloc/free with a new-expression.
+
+static bool counting = false;
+static size_t allocations = 0;
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    void* p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+#endif // ALLOCATION_COUNTER_H
@@ -0,0 +1,191 @@
+#include <unity.h>
+#include <cmath>
+#include <cstdio>
+
+#include "AnalogFilter.h"
+
+// Deterministic noise source so failures are reproducible
+static uint32_t noiseState = 1;
+
+static int noise(int amplitude) {
+    noiseState = noiseState * 1664525u + 1013904223u;
+    return (int)((noiseState >> 8) % (uint32_t)(2 * amplitude + 1)) - amplitude;
+}
+
+// Push 'count' raw conversions of 'raw' and return how many outputs came out
+static int feed(AnalogFilter& filter, uint16_t raw, int count) {
+    int outputs = 0;
+    for (int i = 0; i < count; i++) {
+        if (filter.push(raw)) {
+            outputs++;
+        }
+    }
+    return outputs;
+}
+
+static AnalogFilter configured(uint8_t oversample, uint8_t median, uint8_t average, uint8_t iirShift) {
+    AnalogFilter filter;
+    AnalogFilterConfig config = {oversample, median, average, iirShift};
+    filter.configure(config);
+    return filter;
+}
+
+void setUp(void) {
+    noiseState = 1;
+}
+
+void tearDown(void) {}
+
+void test_config_validation(void) {
+    TEST_ASSERT_TRUE(AnalogFilter::isValid(AnalogFilter::defaults()));
+    TEST_ASSERT_TRUE(AnalogFilter::isValid({64, 7, 16, 8}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({0, 1, 1, 0}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({65, 1, 1, 0}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({1, 2, 1, 0}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({1, 9, 1, 0}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({1, 1, 0, 0}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({1, 1, 17, 0}));
+    TEST_ASSERT_FALSE(AnalogFilter::isValid({1, 1, 1, 9}));
+
+    AnalogFilter filter;
+    AnalogFilterConfig bad = {1, 4, 1, 0};
+    TEST_ASSERT_FALSE(filter.configure(bad));
+    TEST_ASSERT_EQUAL(16, filter.getConfig().oversample);
+}
+
+void test_oversample_decimates_and_averages(void) {
+    AnalogFilter filter = configured(16, 1, 1, 0);
+    int outputs = 0;
+    for (int i = 0; i < 1600; i++) {
+        if (filter.push(i % 2 ? 2008 : 1992)) {
+            outputs++;
+        }
+    }
+    TEST_ASSERT_EQUAL(100, outputs);
+    TEST_ASSERT_EQUAL(2000, filter.value());
+}
+
+void test_step_full_chain(void) {
+    AnalogFilter filter = configured(4, 3, 4, 3);
+    feed(filter, 1000, 400);
+    TEST_ASSERT_EQUAL(1000, filter.value());
+
+    // The output climbs monotonically, never overshoots and settles exactly
+    uint16_t previous = filter.value();
+    int outputs = 0;
+    for (int i = 0; i < 4 * 200; i++) {
+        if (filter.push(3000)) {
+            outputs++;
+            TEST_ASSERT_GREATER_OR_EQUAL(previous, filter.value());
+            TEST_ASSERT_LESS_OR_EQUAL(3000, filter.value());
+            previous = filter.value();
+        }
+    }
+    TEST_ASSERT_EQUAL(200, outputs);
+    TEST_ASSERT_EQUAL(3000, filter.value());
+}
+
+void test_step_iir_time_constant(void) {
+    // With shift 4 each output closes 1/16 of the remaining gap, so 63% of
+    // the step is covered after about 16 outputs
+    AnalogFilter filter = configured(1, 1, 1, 4);
+    filter.push(0);
+    int steps = 0;
+    while (filter.value() < 2580 && steps < 1000) {
+        filter.push(4095);
+        steps++;
+    }
+    TEST_ASSERT_INT_WITHIN(2, 16, steps);
+
+    feed(filter, 4095, 300);
+    TEST_ASSERT_EQUAL(4095, filter.value());
+}
+
+void test_impulse_rejected_by_median(void) {
+    AnalogFilter filter = configured(4, 3, 4, 3);
+    feed(filter, 1000, 400);
+
+    // One full oversampling group of full scale: a single-sample spike once
+    // decimated, which the 3-wide median removes before the average sees it
+    feed(filter, 4095, 4);
+    TEST_ASSERT_EQUAL(1000, filter.value());
+    for (int i = 0; i < 40; i++) {
+        feed(filter, 1000, 4);
+        TEST_ASSERT_EQUAL(1000, filter.value());
+    }
+}
+
+void test_impulse_without_median_decays(void) {
+    AnalogFilter filter = configured(4, 1, 4, 3);
+    feed(filter, 1000, 400);
+
+    feed(filter, 4095, 4);
+    uint16_t peak = filter.value();
+    TEST_ASSERT_GREATER_THAN(1000, peak);
+    // Average and IIR both attenuate the spike
+    TEST_ASSERT_LESS_THAN(1000 + (4095 - 1000) / 4, peak);
+
+    feed(filter, 1000, 4 * 100);
+    TEST_ASSERT_EQUAL(1000, filter.value());
+}
+
+void test_noise_reduction(void) {
+    AnalogFilter raw = configured(1, 1, 1, 0);
+    AnalogFilter chain = configured(4, 3, 8, 3);
+
+    double rawSum = 0, rawSq = 0, outSum = 0, outSq = 0;
+    int rawCount = 0, outCount = 0;
+    for (int i = 0; i < 40000; i++) {
+        uint16_t sample = (uint16_t)(1500 + noise(50));
+        raw.push(sample);
+        rawSum += raw.value();
+        rawSq += (double)raw.value() * raw.value();
+        rawCount++;
+
+        // Skip the chain's warm-up before measuring
+        if (chain.push(sample) && i >= 4000) {
+            outSum += chain.value();
+            outSq += (double)chain.value() * chain.value();
+            outCount++;
+        }
+    }
+
+    double rawMean = rawSum / rawCount;
+    double rawStd = std::sqrt(rawSq / rawCount - rawMean * rawMean);
+    double outMean = outSum / outCount;
+    double outStd = std::sqrt(outSq / outCount - outMean * outMean);
+
+    char line[120];
+    snprintf(line, sizeof(line), "noise std raw %.2f -> filtered %.2f, mean %.2f", rawStd, outStd, outMean);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_FLOAT_WITHIN(2.0, 1500.0, outMean);
+    TEST_ASSERT_TRUE(outStd * 5 < rawStd);
+}
+
+void test_configure_resets_state(void) {
+    AnalogFilter filter = configured(1, 5, 8, 4);
+    feed(filter, 3000, 100);
+    TEST_ASSERT_TRUE(filter.ready());
+
+    AnalogFilterConfig config = filter.getConfig();
+    filter.configure(config);
+    TEST_ASSERT_FALSE(filter.ready());
+
+    // The first output after a reset is not dragged toward the old level
+    filter.push(500);
+    TEST_ASSERT_EQUAL(500, filter.value());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_config_validation);
+    RUN_TEST(test_oversample_decimates_and_averages);
+    RUN_TEST(test_step_full_chain);
+    RUN_TEST(test_step_iir_time_constant);
+    RUN_TEST(test_impulse_rejected_by_median);
+    RUN_TEST(test_impulse_without_median_decays);
+    RUN_TEST(test_noise_reduction);
+    RUN_TEST(test_configure_resets_state);
+    return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "ConfigSnapshot.h"
+
+// Big enough that copying it is far from atomic; every word of a published
+// copy holds the same generation, so a torn read shows up as a mismatch
+struct Table {
+    uint32_t words[256];
+};
+
+static void relax() {
+    std::this_thread::yield();
+}
+
+static const int READERS = 4;
+static const uint32_t PUBLISHES = 20000;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_edit_starts_from_current(void) {
+    ConfigSnapshot<Table> snapshot(relax);
+    Table& first = snapshot.edit();
+    first.words[0] = 7;
+    snapshot.publish();
+    TEST_ASSERT_EQUAL(1, snapshot.version());
+    TEST_ASSERT_EQUAL(7, snapshot.current().words[0]);
+
+    // Unpublished edits stay invisible
+    Table& second = snapshot.edit();
+    TEST_ASSERT_EQUAL(7, second.words[0]);
+    second.words[0] = 8;
+    {
+        ConfigSnapshot<Table>::Reader table(snapshot);
+        TEST_ASSERT_EQUAL(7, table->words[0]);
+    }
+
+    // Dropping an edit just means not publishing it
+    Table& third = snapshot.edit();
+    TEST_ASSERT_EQUAL(7, third.words[0]);
+}
+
+void test_publish_waits_for_old_readers(void) {
+    static ConfigSnapshot<Table> snapshot(relax);
+    std::atomic<bool> holding(false);
+    std::atomic<uint32_t> seen(0);
+
+    std::thread reader([&]() {
+        ConfigSnapshot<Table>::Reader table(snapshot);
+        holding.store(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        seen.store(table->words[0]);
+    });
+
+    while (!holding.load()) {
+        std::this_thread::yield();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Table& table = snapshot.edit();
+    table.words[0] = 1;
+    snapshot.publish();
+    double waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    reader.join();
+
+    // The reader kept its old copy to the end, and publish() only returned
+    // once that copy was free again
+    TEST_ASSERT_EQUAL(0, seen.load());
+    TEST_ASSERT_TRUE(waitedMs >= 40.0);
+}
+
+// Several readers hammer the snapshot while the writer keeps editing and
+// publishing. Every view must be whole (no torn reads) and no reader may ever
+// see an older generation after a newer one.
+void test_concurrent_readers_see_whole_copies(void) {
+    static ConfigSnapshot<Table> snapshot(relax);
+    std::atomic<bool> stop(false);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> backwards(0);
+    std::atomic<uint64_t> reads(0);
+    std::atomic<int> running(0);
+    std::vector<std::thread> readers;
+
+    for (int r = 0; r < READERS; r++) {
+        readers.emplace_back([&]() {
+            uint32_t last = 0;
+            uint64_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                {
+                    ConfigSnapshot<Table>::Reader table(snapshot);
+                    uint32_t generation = table->words[0];
+                    for (int i = 1; i < 256; i++) {
+                        if (table->words[i] != generation) {
+                            torn++;
+                            break;
+                        }
+                    }
+                    if (generation < last) {
+                        backwards++;
+                    }
+                    last = generation;
+                }
+                if (count++ == 0) {
+                    running++;
+                }
+                // Let the writer in on hosts with fewer cores than threads
+                if ((count & 0xF) == 0) {
+                    relax();
+                }
+            }
+            reads += count;
+        });
+    }
+
+    // Start writing only once every reader is inside its loop
+    while (running.load() < READERS) {
+        std::this_thread::yield();
+    }
+
+    uint32_t staleEdits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t generation = 1; generation <= PUBLISHES; generation++) {
+        Table& table = snapshot.edit();
+        if (table.words[0] != generation - 1) {
+            staleEdits++;
+        }
+        for (int i = 0; i < 256; i++) {
+            table.words[i] = generation;
+        }
+        snapshot.publish();
+        relax();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stop.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "%u publishes in %.3f s (%.1f us each) against %d readers, %llu reads",
+             PUBLISHES, seconds, seconds * 1e6 / PUBLISHES, READERS, (unsigned long long)reads.load());
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_TRUE(reads.load() > PUBLISHES);
+    TEST_ASSERT_EQUAL(0, torn.load());
+    TEST_ASSERT_EQUAL(0, backwards.load());
+    TEST_ASSERT_EQUAL(0, staleEdits);
+    TEST_ASSERT_EQUAL(PUBLISHES, snapshot.version());
+    TEST_ASSERT_EQUAL(PUBLISHES, snapshot.current().words[255]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_edit_starts_from_current);
+    RUN_TEST(test_publish_waits_for_old_readers);
+    RUN_TEST(test_concurrent_readers_see_whole_copies);
+    return UNITY_END();
+}
@@ -0,0 +1,105 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "DeviceTopics.h"
+#include "PublishQueue.h"
+#include "../AllocationCounter.h"
+
+static const char* const BASE = "esp32vault/ESP32-Vault-A1B2C3D4";
+static const int ROUNDS = 200000;
+
+typedef PublishQueue<16, 1024> Queue;
+
+static void drain(Queue& queue) {
+    Queue::Message message;
+    while (queue.front(message)) {
+        queue.pop();
+    }
+}
+
+void setUp(void) {
+    allocations = 0;
+    counting = false;
+}
+
+void tearDown(void) {}
+
+void test_table_holds_full_topics(void) {
+    DeviceTopicTable table;
+    TEST_ASSERT_EQUAL_STRING("", table.get(DeviceTopic::STATUS));
+    TEST_ASSERT_TRUE(table.build(BASE));
+
+    TEST_ASSERT_EQUAL_STRING("esp32vault/ESP32-Vault-A1B2C3D4/status", table.get(DeviceTopic::STATUS));
+    TEST_ASSERT_EQUAL_STRING("esp32vault/ESP32-Vault-A1B2C3D4/signal/strenght", table.get(DeviceTopic::SIGNAL_STRENGTH));
+    TEST_ASSERT_EQUAL_STRING("esp32vault/ESP32-Vault-A1B2C3D4/ota/status", table.get(DeviceTopic::OTA_STATUS));
+    TEST_ASSERT_EQUAL_STRING("esp32vault/ESP32-Vault-A1B2C3D4/io/config", table.get(DeviceTopic::IO_CONFIG));
+
+    // Looking a topic up returns the same storage every time
+    TEST_ASSERT_EQUAL_PTR(table.get(DeviceTopic::IO_BATCH), table.get(DeviceTopic::IO_BATCH));
+}
+
+void test_long_base_is_reported(void) {
+    DeviceTopicTable table;
+    std::string base(DeviceTopicTable::TOPIC_MAX - 8, 'b');
+    TEST_ASSERT_FALSE(table.build(base.c_str()));
+    TEST_ASSERT_EQUAL(DeviceTopicTable::TOPIC_MAX - 1, strlen(table.get(DeviceTopic::SIGNAL_STRENGTH)));
+}
+
+// Periodic telemetry as the helpers send it (status string, RSSI and a pin
+// value formatted on the stack, topics from the table) against building each
+// topic as baseTopic + "/suffix" per call
+void test_publish_helpers_allocate_nothing(void) {
+    static DeviceTopicTable table;
+    static Queue queue;
+    TEST_ASSERT_TRUE(table.build(BASE));
+    const std::string base(BASE);
+
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+        std::string statusTopic = base + "/status";
+        const char status[] = "online";
+        queue.push(statusTopic.c_str(), reinterpret_cast<const uint8_t*>(status), sizeof(status) - 1, true);
+
+        std::string rssiTopic = base + "/signal/strenght";
+        std::string rssi = std::to_string(-60 - i % 20);
+        queue.push(rssiTopic.c_str(), reinterpret_cast<const uint8_t*>(rssi.c_str()), rssi.length(), false);
+        drain(queue);
+    }
+    double concatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+    size_t concatAllocations = allocations;
+
+    allocations = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+        const char status[] = "online";
+        queue.push(table.get(DeviceTopic::STATUS), reinterpret_cast<const uint8_t*>(status), sizeof(status) - 1, true);
+
+        char rssi[12];
+        size_t length = snprintf(rssi, sizeof(rssi), "%ld", (long)(-60 - i % 20));
+        queue.push(table.get(DeviceTopic::SIGNAL_STRENGTH), reinterpret_cast<const uint8_t*>(rssi), length, false);
+        drain(queue);
+    }
+    double tableNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+    counting = false;
+
+    char line[160];
+    snprintf(line, sizeof(line), "status + RSSI per round: concatenated topics %.1f ns (%.1f allocations), table %.1f ns (%zu allocations)",
+             concatNs, (double)concatAllocations / ROUNDS, tableNs, allocations);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(0, allocations);
+    TEST_ASSERT_TRUE(concatAllocations > 0);
+    TEST_ASSERT_EQUAL(0, queue.droppedCount());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_table_holds_full_topics);
+    RUN_TEST(test_long_base_is_reported);
+    RUN_TEST(test_publish_helpers_allocate_nothing);
+    return UNITY_END();
+}
@@ -0,0 +1,165 @@
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "EventRing.h"
+
+// Same layout as IOEvent; every field is derived from the sequence number so
+// a torn copy shows up as an inconsistent entry.
+struct Edge {
+    uint8_t pin;
+    uint8_t type;
+    int32_t value;
+    int64_t timestamp;
+};
+
+static Edge makeEdge(uint32_t seq) {
+    Edge edge;
+    edge.pin = (uint8_t)(seq & 0x3F);
+    edge.type = (uint8_t)(seq % 3);
+    edge.value = (int32_t)seq;
+    edge.timestamp = (int64_t)seq * 1000003LL + 17;
+    return edge;
+}
+
+static bool consistent(const Edge& edge) {
+    Edge expected = makeEdge((uint32_t)edge.value);
+    return edge.pin == expected.pin && edge.type == expected.type &&
+           edge.timestamp == expected.timestamp;
+}
+
+static const uint32_t STRESS_EDGES = 5000000;
+
+// Edges pushed back to back before the producer lets the consumer catch up.
+// A burst overfills the ring, so every burst races drops against the reader.
+static const uint32_t STRESS_BURST = 96;
+static const size_t STRESS_RING = 64;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_fifo_order(void) {
+    EventRing<Edge, 8> ring;
+    for (uint32_t i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(ring.push(makeEdge(i)));
+    }
+    TEST_ASSERT_EQUAL(5, ring.size());
+
+    Edge edge;
+    for (uint32_t i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(ring.pop(edge));
+        TEST_ASSERT_EQUAL(i, edge.value);
+        TEST_ASSERT_TRUE(consistent(edge));
+    }
+    TEST_ASSERT_FALSE(ring.pop(edge));
+    TEST_ASSERT_EQUAL(0, ring.droppedCount());
+}
+
+void test_overflow_drops_oldest(void) {
+    EventRing<Edge, 8> ring;
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_TRUE(ring.push(makeEdge(i)));
+    }
+    for (uint32_t i = 8; i < 13; i++) {
+        TEST_ASSERT_FALSE(ring.push(makeEdge(i)));
+    }
+    TEST_ASSERT_EQUAL(5, ring.droppedCount());
+    TEST_ASSERT_EQUAL(8, ring.size());
+
+    Edge edge;
+    for (uint32_t i = 5; i < 13; i++) {
+        TEST_ASSERT_TRUE(ring.pop(edge));
+        TEST_ASSERT_EQUAL(i, edge.value);
+    }
+    TEST_ASSERT_FALSE(ring.pop(edge));
+}
+
+void test_index_wraparound(void) {
+    EventRing<Edge, 4> ring;
+    Edge edge;
+    for (uint32_t i = 0; i < 100000; i++) {
+        ring.push(makeEdge(i));
+        TEST_ASSERT_TRUE(ring.pop(edge));
+        TEST_ASSERT_EQUAL(i, edge.value);
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+// One producer thread standing in for the ISR pushes millions of edges into a
+// ring the size of the device's while the consumer drains it. The producer
+// fires bursts larger than the ring and then waits for the consumer to get
+// the ring down to half full, like an edge storm followed by quiet, so the
+// reader keeps copying slots the producer is overwriting. Every entry that
+// comes out must be intact and newer than the previous one, every edge must
+// be accounted for as either consumed or dropped, and a good share of them
+// must have made it through.
+void test_spsc_stress(void) {
+    static EventRing<Edge, STRESS_RING> ring;
+    std::atomic<bool> done(false);
+    uint32_t consumed = 0;
+    uint32_t torn = 0;
+    uint32_t reordered = 0;
+    int64_t last = -1;
+
+    auto consume = [&](const Edge& edge) {
+        if (!consistent(edge)) {
+            torn++;
+        }
+        if ((int64_t)edge.value <= last) {
+            reordered++;
+        }
+        last = edge.value;
+        consumed++;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < STRESS_EDGES; i++) {
+            ring.push(makeEdge(i));
+            if (i % STRESS_BURST == STRESS_BURST - 1) {
+                while (ring.size() > STRESS_RING / 2) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    Edge edge;
+    while (!done.load(std::memory_order_acquire)) {
+        if (ring.pop(edge)) {
+            consume(edge);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    while (ring.pop(edge)) {
+        consume(edge);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    char line[160];
+    snprintf(line, sizeof(line), "%u edges in %.3f s (%.1f M edges/s), consumed %u, dropped %u",
+             STRESS_EDGES, seconds, STRESS_EDGES / seconds / 1e6, consumed, ring.droppedCount());
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_EQUAL(0, reordered);
+    TEST_ASSERT_EQUAL(STRESS_EDGES, consumed + ring.droppedCount());
+    TEST_ASSERT_TRUE(ring.droppedCount() > 0);
+    TEST_ASSERT_TRUE(consumed >= STRESS_EDGES / 4);
+    TEST_ASSERT_EQUAL(STRESS_EDGES - 1, last);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_order);
+    RUN_TEST(test_overflow_drops_oldest);
+    RUN_TEST(test_index_wraparound);
+    RUN_TEST(test_spsc_stress);
+    return UNITY_END();
+}
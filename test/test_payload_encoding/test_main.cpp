@@ -0,0 +1,202 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "PayloadEncoding.h"
+
+static const int ROUNDS = 20000;
+
+// Writes into a fixed buffer, like the queue slots on the device
+struct BufferWriter {
+    uint8_t data[2048];
+    size_t used = 0;
+
+    size_t write(uint8_t c) {
+        if (used == sizeof(data)) {
+            return 0;
+        }
+        data[used++] = c;
+        return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t length) {
+        size_t written = 0;
+        while (written < length && write(buffer[written])) {
+            written++;
+        }
+        return written;
+    }
+};
+
+// Documents shaped like what the firmware publishes
+static void buildAnalogValue(JsonDocument& doc) {
+    doc.set(2731);
+}
+
+static void buildOtaProgress(JsonDocument& doc) {
+    doc["progress"] = 40;
+    doc["status"] = "updating";
+}
+
+static void buildCounter(JsonDocument& doc) {
+    doc["count"] = 1843;
+    doc["total"] = 9921844;
+    doc["hz"] = 12;
+}
+
+static void buildDeviceInfo(JsonDocument& doc) {
+    doc["device_id"] = "ESP32-Vault-A1B2C3D4";
+    doc["uptime"] = 86400;
+    doc["free_heap"] = 187432;
+    doc["wifi_rssi"] = -67;
+    doc["wifi_ssid"] = "fleet-lte-gw";
+    doc["ip_address"] = "10.64.3.17";
+    doc["mqtt_connected"] = true;
+    doc["encoding"] = "msgpack";
+    doc["ota_update_in_progress"] = false;
+    doc["io_events_dropped"] = 0;
+    doc["io_publishes_suppressed"] = 12;
+    doc["io_rule_fires"] = 3;
+    doc["mqtt_queue_depth"] = 0;
+    doc["mqtt_queue_high_water"] = 5;
+    doc["mqtt_queue_dropped"] = 0;
+    doc["mqtt_publish_failed"] = 0;
+}
+
+static void buildBatch(JsonDocument& doc) {
+    doc["t"] = 81234567;
+    JsonArray states = doc.createNestedArray("s");
+    for (int i = 0; i < 8; i++) {
+        JsonArray entry = states.createNestedArray();
+        entry.add(4 + i % 3);
+        entry.add(i & 1);
+        entry.add(i * 1520);
+    }
+}
+
+static void buildHistoryChunk(JsonDocument& doc) {
+    doc["id"] = "gap-17";
+    doc["chunk"] = 0;
+    doc["t"] = 96120044;
+    JsonArray events = doc.createNestedArray("events");
+    for (int i = 0; i < 16; i++) {
+        JsonArray entry = events.createNestedArray();
+        entry.add(81234567 + i * 61000);
+        entry.add(4);
+        entry.add(i & 1);
+    }
+}
+
+struct Message {
+    const char* name;
+    void (*build)(JsonDocument& doc);
+};
+
+static const Message MESSAGES[] = {
+    {"analog value", buildAnalogValue},
+    {"OTA progress", buildOtaProgress},
+    {"counter", buildCounter},
+    {"device info", buildDeviceInfo},
+    {"batch (8)", buildBatch},
+    {"history (16)", buildHistoryChunk},
+};
+
+static double encodeNs(PayloadEncoding encoding, const JsonDocument& doc) {
+    static BufferWriter out;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+        out.used = 0;
+        encodePayload(encoding, doc, out);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_parse_encoding(void) {
+    PayloadEncoding encoding = PayloadEncoding::JSON;
+    TEST_ASSERT_TRUE(parseEncoding("msgpack", encoding));
+    TEST_ASSERT_TRUE(encoding == PayloadEncoding::MSGPACK);
+    TEST_ASSERT_TRUE(parseEncoding("json", encoding));
+    TEST_ASSERT_TRUE(encoding == PayloadEncoding::JSON);
+
+    // Unknown names leave the setting alone
+    TEST_ASSERT_FALSE(parseEncoding("cbor", encoding));
+    TEST_ASSERT_TRUE(encoding == PayloadEncoding::JSON);
+    TEST_ASSERT_EQUAL_STRING("msgpack", encodingName(PayloadEncoding::MSGPACK));
+}
+
+// Every message measures to exactly what is written and decodes back to the
+// same document in both encodings
+void test_round_trip(void) {
+    static BufferWriter out;
+    for (const Message& message : MESSAGES) {
+        StaticJsonDocument<2048> doc;
+        message.build(doc);
+        std::string expected;
+        serializeJson(doc, expected);
+
+        const PayloadEncoding encodings[] = {PayloadEncoding::JSON, PayloadEncoding::MSGPACK};
+        for (PayloadEncoding encoding : encodings) {
+            out.used = 0;
+            size_t length = encodePayload(encoding, doc, out);
+            TEST_ASSERT_EQUAL_MESSAGE(measurePayload(encoding, doc), length, message.name);
+            TEST_ASSERT_EQUAL_MESSAGE(length, out.used, message.name);
+
+            StaticJsonDocument<2048> decoded;
+            TEST_ASSERT_FALSE_MESSAGE(decodePayload(encoding, decoded, reinterpret_cast<const char*>(out.data), out.used),
+                                      message.name);
+            std::string actual;
+            serializeJson(decoded, actual);
+            TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.c_str(), actual.c_str(), message.name);
+        }
+    }
+}
+
+// Existing tools keep sending JSON commands after the device switches over
+void test_msgpack_mode_accepts_json_commands(void) {
+    const char command[] = "  {\"encoding\":\"json\"}";
+    StaticJsonDocument<64> doc;
+    TEST_ASSERT_FALSE(decodePayload(PayloadEncoding::MSGPACK, doc, command, sizeof(command) - 1));
+    TEST_ASSERT_EQUAL_STRING("json", doc["encoding"] | "");
+}
+
+// Bytes on the wire and host encode time per message, JSON against MessagePack
+void test_msgpack_size_and_time(void) {
+    size_t jsonTotal = 0;
+    size_t msgpackTotal = 0;
+    for (const Message& message : MESSAGES) {
+        StaticJsonDocument<2048> doc;
+        message.build(doc);
+        size_t jsonBytes = measurePayload(PayloadEncoding::JSON, doc);
+        size_t msgpackBytes = measurePayload(PayloadEncoding::MSGPACK, doc);
+        double jsonNs = encodeNs(PayloadEncoding::JSON, doc);
+        double msgpackNs = encodeNs(PayloadEncoding::MSGPACK, doc);
+
+        char line[160];
+        snprintf(line, sizeof(line), "%-13s JSON %4zu B %7.1f ns, MessagePack %4zu B (%3.0f%%) %7.1f ns",
+                 message.name, jsonBytes, jsonNs, msgpackBytes, 100.0 * msgpackBytes / jsonBytes, msgpackNs);
+        TEST_MESSAGE(line);
+
+        TEST_ASSERT_TRUE_MESSAGE(msgpackBytes < jsonBytes, message.name);
+        jsonTotal += jsonBytes;
+        msgpackTotal += msgpackBytes;
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "all messages: JSON %zu B, MessagePack %zu B (%.0f%%)",
+             jsonTotal, msgpackTotal, 100.0 * msgpackTotal / jsonTotal);
+    TEST_MESSAGE(line);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_encoding);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_msgpack_mode_accepts_json_commands);
+    RUN_TEST(test_msgpack_size_and_time);
+    return UNITY_END();
+}
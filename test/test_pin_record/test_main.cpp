@@ -0,0 +1,531 @@
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PinRecord.h"
+
+// The firmware's record store (PinRecordStore) run against an in-memory NVS,
+// plus a boot-time and flash-write comparison against the single JSON blob
+// ("pins") that earlier firmware rewrote on every change.
+
+static const uint8_t PIN_COUNT = 20;
+static const int BOOT_ROUNDS = 2000;
+
+// Room for PIN_COUNT pins of 16 members with host-sized (64-bit) slots
+static const size_t JSON_DOC_CAPACITY = 32768;
+
+// The Preferences calls PinRecordStore uses, counting the bytes each put writes
+struct FakeNvs {
+    std::map<std::string, std::vector<uint8_t>> entries;
+    size_t bytesWritten = 0;
+
+    size_t putBytes(const char* key, const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        entries[key].assign(bytes, bytes + length);
+        bytesWritten += length;
+        return length;
+    }
+
+    size_t getBytesLength(const char* key) const {
+        auto it = entries.find(key);
+        return it == entries.end() ? 0 : it->second.size();
+    }
+
+    size_t getBytes(const char* key, void* data, size_t length) const {
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.size() > length) {
+            return 0;
+        }
+        memcpy(data, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t putULong64(const char* key, uint64_t value) {
+        return putBytes(key, &value, sizeof(value));
+    }
+
+    uint64_t getULong64(const char* key, uint64_t defaultValue) const {
+        uint64_t value;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+
+    size_t putString(const char* key, const std::string& value) {
+        return putBytes(key, value.data(), value.size());
+    }
+
+    std::string getString(const char* key, const char* defaultValue) const {
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            return defaultValue;
+        }
+        return std::string(it->second.begin(), it->second.end());
+    }
+
+    bool isKey(const char* key) const {
+        return entries.count(key) != 0;
+    }
+
+    bool remove(const char* key) {
+        return entries.erase(key) != 0;
+    }
+};
+
+typedef PinRecordStore<FakeNvs> Store;
+
+// Same fields as the firmware's PinConfig
+struct TestConfig {
+    uint8_t pin;
+    PinMode mode;
+    InterruptEdge edge;
+    uint16_t debounceMs;
+    uint16_t pulseWidthMs;
+    uint32_t reportIntervalMs;
+    AnalogFilterConfig filter;
+    uint16_t deadband;
+    uint16_t deadbandPermille;
+    uint32_t heartbeatMs;
+    std::string reportTopic;
+    bool persist;
+    bool retain;
+};
+
+static TestConfig makeConfig(uint8_t index) {
+    TestConfig config;
+    config.pin = index + 4;
+    config.mode = (PinMode)(1 + index % 6);
+    config.edge = (InterruptEdge)(index % 4);
+    config.debounceMs = 50;
+    config.pulseWidthMs = 100;
+    config.reportIntervalMs = 1000 * (index + 1);
+    config.filter = {16, 3, 4, 2};
+    config.deadband = 8;
+    config.deadbandPermille = 25;
+    config.heartbeatMs = 60000;
+    config.reportTopic = "esp32vault/ESP32-Vault-A1B2C3D4/io/" + std::to_string(config.pin) + "/state";
+    config.persist = true;
+    config.retain = index & 0x1;
+    return config;
+}
+
+static const char* const MODE_NAMES[] = {"none", "output", "input", "input_pullup", "analog", "interrupt", "counter"};
+static const char* const EDGE_NAMES[] = {"none", "rising", "falling", "change"};
+
+static PinMode modeFromName(const char* name) {
+    for (uint8_t m = 0; m < sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]); m++) {
+        if (strcmp(name, MODE_NAMES[m]) == 0) {
+            return (PinMode)m;
+        }
+    }
+    return PinMode::NONE;
+}
+
+// The "pins" document written by the JSON-based firmware
+static std::string buildJsonBlob(const TestConfig* configs, uint8_t count) {
+    DynamicJsonDocument doc(JSON_DOC_CAPACITY);
+    JsonArray pins = doc.createNestedArray("pins");
+    for (uint8_t i = 0; i < count; i++) {
+        const TestConfig& config = configs[i];
+        JsonObject pin = pins.createNestedObject();
+        pin["pin"] = config.pin;
+        pin["mode"] = MODE_NAMES[(uint8_t)config.mode];
+        if (config.edge != InterruptEdge::NONE) {
+            pin["edge"] = EDGE_NAMES[(uint8_t)config.edge];
+        }
+        pin["debounce"] = config.debounceMs;
+        pin["pulse"] = config.pulseWidthMs;
+        pin["interval"] = config.reportIntervalMs;
+        pin["oversample"] = config.filter.oversample;
+        pin["median"] = config.filter.median;
+        pin["average"] = config.filter.average;
+        pin["iir"] = config.filter.iirShift;
+        pin["deadband"] = config.deadband;
+        pin["deadband_pct"] = config.deadbandPermille / 10.0f;
+        pin["heartbeat"] = config.heartbeatMs;
+        pin["report_topic"] = config.reportTopic.c_str();
+        pin["persist"] = true;
+        pin["retain"] = config.retain;
+    }
+
+    std::string blob;
+    serializeJson(doc, blob);
+    return blob;
+}
+
+// Boot path of the JSON format: parse the blob and pull every field out
+static uint8_t loadJson(const FakeNvs& nvs, TestConfig* out) {
+    std::string blob = nvs.getString(PIN_JSON_KEY, "");
+    DynamicJsonDocument doc(JSON_DOC_CAPACITY);
+    if (deserializeJson(doc, blob.c_str(), blob.size())) {
+        return 0;
+    }
+
+    uint8_t loaded = 0;
+    for (JsonObjectConst pin : doc["pins"].as<JsonArrayConst>()) {
+        TestConfig& config = out[loaded];
+        config.pin = pin["pin"] | 0;
+        config.mode = modeFromName(pin["mode"] | "none");
+        config.debounceMs = pin["debounce"] | 0;
+        config.pulseWidthMs = pin["pulse"] | 0;
+        config.reportIntervalMs = pin["interval"] | 0;
+        config.filter.oversample = pin["oversample"] | 16;
+        config.filter.median = pin["median"] | 1;
+        config.filter.average = pin["average"] | 1;
+        config.filter.iirShift = pin["iir"] | 0;
+        config.deadband = pin["deadband"] | 0;
+        config.deadbandPermille = (uint16_t)((pin["deadband_pct"] | 0.0f) * 10.0f + 0.5f);
+        config.heartbeatMs = pin["heartbeat"] | 0;
+        config.reportTopic = pin["report_topic"] | "";
+        config.retain = pin["retain"] | false;
+        loaded++;
+    }
+    return loaded;
+}
+
+// Boot path of the binary format, as InputManager::loadConfig() walks it
+static uint8_t loadRecords(FakeNvs& nvs, TestConfig* out) {
+    Store store(nvs);
+    store.begin();
+
+    uint8_t loaded = 0;
+    uint64_t pending = store.pins();
+    while (pending != 0) {
+        uint8_t pin = __builtin_ctzll(pending);
+        pending &= pending - 1;
+
+        PinRecord record;
+        if (!store.read(pin, record)) {
+            continue;
+        }
+        unpackPinRecord(record, out[loaded++]);
+    }
+    return loaded;
+}
+
+static void saveRecords(Store& store, const TestConfig* configs) {
+    for (uint8_t i = 0; i < PIN_COUNT; i++) {
+        PinRecord record;
+        packPinRecord(configs[i], record);
+        TEST_ASSERT_TRUE(store.write(record) == PinRecordWrite::WRITTEN);
+    }
+}
+
+static void assertSameConfig(const TestConfig& expected, const TestConfig& actual) {
+    TEST_ASSERT_EQUAL(expected.pin, actual.pin);
+    TEST_ASSERT_TRUE(expected.mode == actual.mode);
+    TEST_ASSERT_TRUE(expected.edge == actual.edge);
+    TEST_ASSERT_EQUAL(expected.debounceMs, actual.debounceMs);
+    TEST_ASSERT_EQUAL(expected.pulseWidthMs, actual.pulseWidthMs);
+    TEST_ASSERT_EQUAL(expected.reportIntervalMs, actual.reportIntervalMs);
+    TEST_ASSERT_EQUAL_MEMORY(&expected.filter, &actual.filter, sizeof(AnalogFilterConfig));
+    TEST_ASSERT_EQUAL(expected.deadband, actual.deadband);
+    TEST_ASSERT_EQUAL(expected.deadbandPermille, actual.deadbandPermille);
+    TEST_ASSERT_EQUAL(expected.heartbeatMs, actual.heartbeatMs);
+    TEST_ASSERT_EQUAL_STRING(expected.reportTopic.c_str(), actual.reportTopic.c_str());
+    TEST_ASSERT_TRUE(actual.persist);
+    TEST_ASSERT_EQUAL(expected.retain, actual.retain);
+}
+
+static TestConfig configs[PIN_COUNT];
+
+void setUp(void) {
+    for (uint8_t i = 0; i < PIN_COUNT; i++) {
+        configs[i] = makeConfig(i);
+    }
+}
+
+void tearDown(void) {}
+
+void test_record_key_and_layout(void) {
+    char key[8];
+    pinRecordKey(39, key, sizeof(key));
+    TEST_ASSERT_EQUAL_STRING("p39", key);
+
+    // NVS keys are limited to 15 characters
+    TEST_ASSERT_LESS_THAN(16, strlen(PIN_INDEX_KEY));
+    TEST_ASSERT_EQUAL(0, offsetof(PinRecord, version));
+    TEST_ASSERT_EQUAL(156, sizeof(PinRecord));
+}
+
+void test_records_round_trip(void) {
+    FakeNvs nvs;
+    Store store(nvs);
+    store.begin();
+    saveRecords(store, configs);
+
+    // A fresh store (the next boot) finds every pin through the index
+    TestConfig loaded[PIN_COUNT];
+    TEST_ASSERT_EQUAL(PIN_COUNT, loadRecords(nvs, loaded));
+    for (uint8_t i = 0; i < PIN_COUNT; i++) {
+        assertSameConfig(configs[i], loaded[i]);
+    }
+}
+
+// Leftovers in the record never leak into the stored bytes, so re-sending a
+// configuration always compares equal to what is stored
+void test_pack_is_deterministic(void) {
+    PinRecord first;
+    PinRecord second;
+    memset(&first, 0xA5, sizeof(first));
+    memset(&second, 0x5A, sizeof(second));
+    packPinRecord(configs[0], first);
+    packPinRecord(configs[0], second);
+    TEST_ASSERT_EQUAL_MEMORY(&first, &second, sizeof(PinRecord));
+
+    // Over-long topics are cut and stay terminated
+    configs[0].reportTopic.assign(PIN_RECORD_TOPIC_SIZE + 10, 't');
+    packPinRecord(configs[0], first);
+    TEST_ASSERT_EQUAL(PIN_RECORD_TOPIC_SIZE - 1, strlen(first.reportTopic));
+}
+
+void test_invalid_records_are_rejected(void) {
+    PinRecord good;
+    configs[0].mode = PinMode::ANALOG_MODE;
+    packPinRecord(configs[0], good);
+    uint8_t pin = configs[0].pin;
+
+    PinRecord record = good;
+    TEST_ASSERT_TRUE(pinRecordValid(record, pin));
+    TEST_ASSERT_FALSE(pinRecordValid(record, pin + 1));
+
+    record = good;
+    record.version = PIN_RECORD_VERSION + 1;
+    TEST_ASSERT_FALSE(pinRecordValid(record, pin));
+
+    record = good;
+    record.mode = (uint8_t)PinMode::COUNTER_MODE + 1;
+    TEST_ASSERT_FALSE(pinRecordValid(record, pin));
+
+    record = good;
+    record.edge = (uint8_t)InterruptEdge::CHANGE_EDGE + 1;
+    TEST_ASSERT_FALSE(pinRecordValid(record, pin));
+
+    record = good;
+    record.filter.median = 2;
+    TEST_ASSERT_FALSE(pinRecordValid(record, pin));
+
+    record = good;
+    record.reportTopic[0] = '\0';
+    TEST_ASSERT_FALSE(pinRecordValid(record, pin));
+
+    // An unterminated topic is cut at the end of the field
+    record = good;
+    memset(record.reportTopic, 'x', PIN_RECORD_TOPIC_SIZE);
+    TEST_ASSERT_TRUE(pinRecordValid(record, pin));
+    TEST_ASSERT_EQUAL(PIN_RECORD_TOPIC_SIZE - 1, strlen(record.reportTopic));
+}
+
+void test_store_rejects_bad_entries(void) {
+    FakeNvs nvs;
+    Store store(nvs);
+    store.begin();
+    saveRecords(store, configs);
+
+    char key[8];
+    pinRecordKey(configs[3].pin, key, sizeof(key));
+    nvs.entries[key][0] = PIN_RECORD_VERSION + 1;
+    pinRecordKey(configs[5].pin, key, sizeof(key));
+    nvs.entries[key].resize(sizeof(PinRecord) - 4);
+
+    PinRecord record;
+    TEST_ASSERT_FALSE(store.read(configs[3].pin, record));
+    TEST_ASSERT_FALSE(store.read(configs[5].pin, record));
+    TEST_ASSERT_TRUE(store.read(configs[4].pin, record));
+
+    TestConfig loaded[PIN_COUNT];
+    TEST_ASSERT_EQUAL(PIN_COUNT - 2, loadRecords(nvs, loaded));
+}
+
+void test_writes_and_index(void) {
+    FakeNvs nvs;
+    Store store(nvs);
+    store.begin();
+
+    // A new pin writes its record and the index
+    PinRecord record;
+    packPinRecord(configs[0], record);
+    TEST_ASSERT_TRUE(store.write(record) == PinRecordWrite::WRITTEN);
+    TEST_ASSERT_EQUAL(sizeof(PinRecord) + sizeof(uint64_t), nvs.bytesWritten);
+    TEST_ASSERT_EQUAL(1ULL << configs[0].pin, nvs.getULong64(PIN_INDEX_KEY, 0));
+
+    // The same configuration again costs nothing
+    nvs.bytesWritten = 0;
+    TEST_ASSERT_TRUE(store.write(record) == PinRecordWrite::UNCHANGED);
+    TEST_ASSERT_EQUAL(0, nvs.bytesWritten);
+
+    // A changed pin rewrites its record only
+    configs[0].reportIntervalMs = 250;
+    packPinRecord(configs[0], record);
+    TEST_ASSERT_TRUE(store.write(record) == PinRecordWrite::WRITTEN);
+    TEST_ASSERT_EQUAL(sizeof(PinRecord), nvs.bytesWritten);
+
+    store.erase(configs[0].pin);
+    TEST_ASSERT_EQUAL(0, store.pins());
+    TEST_ASSERT_EQUAL(0, nvs.getULong64(PIN_INDEX_KEY, 1));
+    TEST_ASSERT_FALSE(store.read(configs[0].pin, record));
+
+    // Erasing a pin without a record touches nothing
+    nvs.bytesWritten = 0;
+    store.erase(configs[1].pin);
+    TEST_ASSERT_EQUAL(0, nvs.bytesWritten);
+}
+
+// The "pins" list of earlier firmware becomes one record per accepted entry
+// and is deleted afterwards
+void test_json_list_is_migrated(void) {
+    // Only the fields the converter reads, so the list fits the store's
+    // fixed-size document on 64-bit hosts too
+    configs[2].reportTopic = "";    // Rejected by the converter below
+    DynamicJsonDocument list(JSON_DOC_CAPACITY);
+    JsonArray pins = list.createNestedArray("pins");
+    for (uint8_t i = 0; i < 4; i++) {
+        JsonObject pin = pins.createNestedObject();
+        pin["pin"] = configs[i].pin;
+        pin["mode"] = MODE_NAMES[(uint8_t)configs[i].mode];
+        pin["interval"] = configs[i].reportIntervalMs;
+        pin["report_topic"] = configs[i].reportTopic.c_str();
+        pin["retain"] = configs[i].retain;
+    }
+    std::string blob;
+    serializeJson(list, blob);
+
+    FakeNvs nvs;
+    nvs.putString(PIN_JSON_KEY, blob);
+
+    Store store(nvs);
+    store.begin();
+    TEST_ASSERT_TRUE(store.hasJson());
+
+    int migrated = store.migrateJson([](JsonVariantConst entry, PinRecord& record) {
+        TestConfig config = makeConfig(0);
+        config.pin = entry["pin"] | 0;
+        config.mode = modeFromName(entry["mode"] | "none");
+        config.edge = InterruptEdge::NONE;
+        config.reportIntervalMs = entry["interval"] | 0;
+        config.reportTopic = entry["report_topic"] | "";
+        config.retain = entry["retain"] | false;
+        if (config.reportTopic.empty()) {
+            return false;
+        }
+        packPinRecord(config, record);
+        return true;
+    });
+
+    TEST_ASSERT_EQUAL(3, migrated);
+    TEST_ASSERT_FALSE(store.hasJson());
+    TEST_ASSERT_FALSE(nvs.isKey(PIN_JSON_KEY));
+    TEST_ASSERT_EQUAL((1ULL << configs[0].pin) | (1ULL << configs[1].pin) | (1ULL << configs[3].pin), store.pins());
+
+    PinRecord record;
+    TEST_ASSERT_TRUE(store.read(configs[3].pin, record));
+    TEST_ASSERT_EQUAL(configs[3].reportIntervalMs, record.reportIntervalMs);
+    TEST_ASSERT_EQUAL_STRING(configs[3].reportTopic.c_str(), record.reportTopic);
+    TEST_ASSERT_FALSE(store.read(configs[2].pin, record));
+
+    // The index survives into the next boot
+    Store reboot(nvs);
+    reboot.begin();
+    TEST_ASSERT_EQUAL(store.pins(), reboot.pins());
+}
+
+void test_unreadable_json_list_is_dropped(void) {
+    FakeNvs nvs;
+    nvs.putString(PIN_JSON_KEY, "{\"pins\":[{\"pin\":4,");
+
+    Store store(nvs);
+    store.begin();
+    int calls = 0;
+    int migrated = store.migrateJson([&calls](JsonVariantConst, PinRecord&) {
+        calls++;
+        return false;
+    });
+
+    TEST_ASSERT_EQUAL(-1, migrated);
+    TEST_ASSERT_EQUAL(0, calls);
+    TEST_ASSERT_FALSE(store.hasJson());
+    TEST_ASSERT_EQUAL(0, store.pins());
+}
+
+void test_boot_time(void) {
+    FakeNvs binary;
+    Store store(binary);
+    store.begin();
+    saveRecords(store, configs);
+
+    FakeNvs json;
+    std::string blob = buildJsonBlob(configs, PIN_COUNT);
+    json.putString(PIN_JSON_KEY, blob);
+
+    static TestConfig loaded[PIN_COUNT];
+    auto start = std::chrono::steady_clock::now();
+    uint32_t binaryLoaded = 0;
+    for (int round = 0; round < BOOT_ROUNDS; round++) {
+        binaryLoaded += loadRecords(binary, loaded);
+    }
+    double binaryUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BOOT_ROUNDS;
+
+    start = std::chrono::steady_clock::now();
+    uint32_t jsonLoaded = 0;
+    for (int round = 0; round < BOOT_ROUNDS; round++) {
+        jsonLoaded += loadJson(json, loaded);
+    }
+    double jsonUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BOOT_ROUNDS;
+
+    char line[160];
+    snprintf(line, sizeof(line), "load %u pins: binary records %.2f us, JSON blob (%zu bytes) %.2f us",
+             PIN_COUNT, binaryUs, blob.size(), jsonUs);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(PIN_COUNT * BOOT_ROUNDS, binaryLoaded);
+    TEST_ASSERT_EQUAL(PIN_COUNT * BOOT_ROUNDS, jsonLoaded);
+    TEST_ASSERT_TRUE(binaryUs < jsonUs);
+}
+
+void test_flash_writes_per_change(void) {
+    FakeNvs binary;
+    Store store(binary);
+    store.begin();
+    saveRecords(store, configs);
+
+    FakeNvs json;
+    json.putString(PIN_JSON_KEY, buildJsonBlob(configs, PIN_COUNT));
+
+    // Change one pin's interval: the store rewrites that record only, the
+    // JSON format rewrites the whole document
+    configs[7].reportIntervalMs = 250;
+
+    binary.bytesWritten = 0;
+    PinRecord record;
+    packPinRecord(configs[7], record);
+    TEST_ASSERT_TRUE(store.write(record) == PinRecordWrite::WRITTEN);
+
+    json.bytesWritten = 0;
+    json.putString(PIN_JSON_KEY, buildJsonBlob(configs, PIN_COUNT));
+
+    char line[120];
+    snprintf(line, sizeof(line), "one pin changed: binary writes %zu bytes, JSON writes %zu bytes",
+             binary.bytesWritten, json.bytesWritten);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(sizeof(PinRecord), binary.bytesWritten);
+    TEST_ASSERT_TRUE(binary.bytesWritten * 10 < json.bytesWritten);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_record_key_and_layout);
+    RUN_TEST(test_records_round_trip);
+    RUN_TEST(test_pack_is_deterministic);
+    RUN_TEST(test_invalid_records_are_rejected);
+    RUN_TEST(test_store_rejects_bad_entries);
+    RUN_TEST(test_writes_and_index);
+    RUN_TEST(test_json_list_is_migrated);
+    RUN_TEST(test_unreadable_json_list_is_dropped);
+    RUN_TEST(test_boot_time);
+    RUN_TEST(test_flash_writes_per_change);
+    return UNITY_END();
+}
@@ -0,0 +1,239 @@
+#include <unity.h>
+
+#include "RuleEngine.h"
+
+// Compiled rule programs run against a stream of input values. A rule's
+// action fires only when its condition's result changes (or a new edge keeps
+// it true), never on every evaluation.
+
+static const RuleAction NONE = {RuleActionType::NONE, 0, 0};
+static const RuleAction SET_12 = {RuleActionType::SET, 12, 0};
+static const RuleAction RESET_12 = {RuleActionType::RESET, 12, 0};
+static const RuleAction TOGGLE_13 = {RuleActionType::TOGGLE, 13, 0};
+
+static RuleProgram program;
+static RuleEngine engine;
+static RuleAction fired[RuleProgram::MAX_RULES];
+
+// Load one rule into a fresh program and take the current values as baseline
+static void load(const RuleInstruction* condition, uint8_t length,
+                 const RuleAction& onTrue, const RuleAction& onFalse) {
+    program.clear();
+    program.version++;
+    TEST_ASSERT_TRUE(program.addRule(condition, length, onTrue, onFalse));
+    engine.reset(program);
+}
+
+static uint8_t feed(uint8_t pin, int32_t value) {
+    return engine.update(program, pin, value, fired, RuleProgram::MAX_RULES);
+}
+
+void setUp(void) {
+    program.version = 0;
+    program.clear();
+    engine = RuleEngine();
+}
+
+void tearDown(void) {}
+
+void test_add_rule_checks_stack_shape(void) {
+    RuleInstruction single[] = {{RuleOp::LEVEL, 5, 1}};
+    RuleInstruction twoLeft[] = {{RuleOp::LEVEL, 5, 1}, {RuleOp::LEVEL, 6, 1}};
+    RuleInstruction shortAnd[] = {{RuleOp::LEVEL, 5, 1}, {RuleOp::AND, 0, 2}};
+    RuleInstruction emptyOr[] = {{RuleOp::LEVEL, 5, 1}, {RuleOp::OR, 0, 0}};
+    RuleInstruction bareNot[] = {{RuleOp::NOT, 0, 0}};
+    RuleInstruction badPin[] = {{RuleOp::LEVEL, RuleEngine::MAX_PINS, 1}};
+
+    TEST_ASSERT_FALSE(program.addRule(single, 0, SET_12, NONE));
+    TEST_ASSERT_FALSE(program.addRule(twoLeft, 2, SET_12, NONE));
+    TEST_ASSERT_FALSE(program.addRule(shortAnd, 2, SET_12, NONE));
+    TEST_ASSERT_FALSE(program.addRule(emptyOr, 2, SET_12, NONE));
+    TEST_ASSERT_FALSE(program.addRule(bareNot, 1, SET_12, NONE));
+    TEST_ASSERT_FALSE(program.addRule(badPin, 1, SET_12, NONE));
+
+    RuleInstruction deep[RuleProgram::MAX_STACK + 1];
+    for (uint8_t i = 0; i < RuleProgram::MAX_STACK + 1; i++) {
+        deep[i] = {RuleOp::LEVEL, i, 1};
+    }
+    TEST_ASSERT_FALSE(program.addRule(deep, RuleProgram::MAX_STACK + 1, SET_12, NONE));
+    TEST_ASSERT_EQUAL(0, program.ruleCount);
+
+    for (uint8_t i = 0; i < RuleProgram::MAX_RULES; i++) {
+        TEST_ASSERT_TRUE(program.addRule(single, 1, SET_12, NONE));
+    }
+    TEST_ASSERT_FALSE(program.addRule(single, 1, SET_12, NONE));
+    TEST_ASSERT_EQUAL((uint64_t)1 << 5, program.inputMask);
+}
+
+void test_rose_fires_once_per_rising_edge(void) {
+    RuleInstruction rose[] = {{RuleOp::ROSE, 4, 0}};
+    engine.setValue(4, 0);
+    load(rose, 1, TOGGLE_13, NONE);
+
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::TOGGLE, fired[0].type);
+    TEST_ASSERT_EQUAL(13, fired[0].pin);
+    TEST_ASSERT_EQUAL(0, feed(4, 1));   // Repeated level is not an edge
+    TEST_ASSERT_EQUAL(0, feed(4, 0));   // Going false has no else action
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+}
+
+void test_fell_runs_else_when_edge_passes(void) {
+    RuleInstruction fell[] = {{RuleOp::FELL, 4, 0}};
+    engine.setValue(4, 1);
+    load(fell, 1, SET_12, RESET_12);
+
+    TEST_ASSERT_EQUAL(0, feed(4, 1));
+    TEST_ASSERT_EQUAL(1, feed(4, 0));
+    TEST_ASSERT_EQUAL(RuleActionType::SET, fired[0].type);
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::RESET, fired[0].type);
+    TEST_ASSERT_EQUAL(0, feed(4, 1));
+}
+
+void test_changed_fires_on_every_edge(void) {
+    RuleInstruction changed[] = {{RuleOp::CHANGED, 4, 0}};
+    engine.setValue(4, 0);
+    load(changed, 1, TOGGLE_13, NONE);
+
+    // Interrupt pins only report changes, so every update is a new edge
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(1, feed(4, (i + 1) & 0x1));
+    }
+    TEST_ASSERT_EQUAL(0, feed(4, 0));   // Same value again
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+}
+
+void test_edges_need_a_known_previous_value(void) {
+    RuleInstruction changed[] = {{RuleOp::CHANGED, 4, 0}};
+    load(changed, 1, TOGGLE_13, NONE);
+
+    // The first value after boot is not a change
+    TEST_ASSERT_EQUAL(0, feed(4, 1));
+    TEST_ASSERT_EQUAL(1, feed(4, 0));
+}
+
+void test_thresholds_fire_on_crossing_only(void) {
+    RuleInstruction above[] = {{RuleOp::ABOVE, 34, 2000}};
+    engine.setValue(34, 1000);
+    load(above, 1, SET_12, RESET_12);
+
+    TEST_ASSERT_EQUAL(0, feed(34, 1500));
+    TEST_ASSERT_EQUAL(0, feed(34, 2000));   // Strictly above
+    TEST_ASSERT_EQUAL(1, feed(34, 2001));
+    TEST_ASSERT_EQUAL(RuleActionType::SET, fired[0].type);
+    for (int32_t value = 2100; value < 4000; value += 100) {
+        TEST_ASSERT_EQUAL(0, feed(34, value));
+    }
+    TEST_ASSERT_EQUAL(1, feed(34, 100));
+    TEST_ASSERT_EQUAL(RuleActionType::RESET, fired[0].type);
+
+    RuleInstruction below[] = {{RuleOp::BELOW, 34, 500}};
+    load(below, 1, SET_12, NONE);
+    TEST_ASSERT_EQUAL(0, feed(34, 50));     // True at load: baseline, no action
+    TEST_ASSERT_EQUAL(0, feed(34, 500));
+    TEST_ASSERT_EQUAL(1, feed(34, 499));
+}
+
+void test_and_or_not(void) {
+    // all(pin 5 high, any(pin 34 above 2000, not(pin 6 high)))
+    RuleInstruction condition[] = {
+        {RuleOp::LEVEL, 5, 1},
+        {RuleOp::ABOVE, 34, 2000},
+        {RuleOp::LEVEL, 6, 1},
+        {RuleOp::NOT, 0, 0},
+        {RuleOp::OR, 0, 2},
+        {RuleOp::AND, 0, 2},
+    };
+    engine.setValue(5, 0);
+    engine.setValue(6, 1);
+    engine.setValue(34, 1000);
+    load(condition, 6, SET_12, RESET_12);
+    TEST_ASSERT_EQUAL(((uint64_t)1 << 5) | ((uint64_t)1 << 6) | ((uint64_t)1 << 34), program.inputMask);
+
+    TEST_ASSERT_EQUAL(0, feed(5, 1));       // any() still false
+    TEST_ASSERT_EQUAL(1, feed(6, 0));       // not() makes it true
+    TEST_ASSERT_EQUAL(RuleActionType::SET, fired[0].type);
+    TEST_ASSERT_EQUAL(0, feed(34, 3000));   // Second way of staying true
+    TEST_ASSERT_EQUAL(0, feed(6, 1));
+    TEST_ASSERT_EQUAL(1, feed(34, 1000));
+    TEST_ASSERT_EQUAL(RuleActionType::RESET, fired[0].type);
+    TEST_ASSERT_EQUAL(0, feed(5, 0));
+    TEST_ASSERT_EQUAL(0, feed(6, 0));       // all() blocked by pin 5
+    TEST_ASSERT_EQUAL(1, feed(5, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::SET, fired[0].type);
+}
+
+void test_edge_gated_by_level(void) {
+    // Rising edge of pin 4 while pin 5 is high
+    RuleInstruction condition[] = {{RuleOp::ROSE, 4, 0}, {RuleOp::LEVEL, 5, 1}, {RuleOp::AND, 0, 2}};
+    engine.setValue(4, 0);
+    engine.setValue(5, 0);
+    load(condition, 3, TOGGLE_13, NONE);
+
+    TEST_ASSERT_EQUAL(0, feed(4, 1));
+    TEST_ASSERT_EQUAL(0, feed(4, 0));
+    TEST_ASSERT_EQUAL(0, feed(5, 1));       // Level alone never fires an edge rule
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+    TEST_ASSERT_EQUAL(0, feed(5, 1));
+    TEST_ASSERT_EQUAL(0, feed(4, 0));
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+}
+
+void test_not_of_edge_does_not_refire(void) {
+    RuleInstruction condition[] = {{RuleOp::ROSE, 4, 0}, {RuleOp::NOT, 0, 0}};
+    engine.setValue(4, 0);
+    load(condition, 2, SET_12, RESET_12);
+
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::RESET, fired[0].type);
+    TEST_ASSERT_EQUAL(1, feed(4, 0));
+    TEST_ASSERT_EQUAL(RuleActionType::SET, fired[0].type);
+    TEST_ASSERT_EQUAL(0, feed(4, 0));       // Still true, but no edge matched
+    TEST_ASSERT_EQUAL(1, feed(4, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::RESET, fired[0].type);
+}
+
+void test_only_rules_reading_the_pin_run(void) {
+    RuleInstruction first[] = {{RuleOp::LEVEL, 5, 1}};
+    RuleInstruction second[] = {{RuleOp::LEVEL, 6, 1}};
+    program.clear();
+    program.version++;
+    TEST_ASSERT_TRUE(program.addRule(first, 1, SET_12, NONE));
+    TEST_ASSERT_TRUE(program.addRule(second, 1, TOGGLE_13, NONE));
+    TEST_ASSERT_TRUE(engine.needsReset(program));
+    engine.reset(program);
+    TEST_ASSERT_FALSE(engine.needsReset(program));
+
+    TEST_ASSERT_EQUAL(1, feed(6, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::TOGGLE, fired[0].type);
+    TEST_ASSERT_EQUAL(0, feed(7, 1));
+    TEST_ASSERT_EQUAL(0, feed(RuleEngine::MAX_PINS, 1));
+
+    // Actions beyond maxFired are dropped, not written past the buffer
+    RuleInstruction both[] = {{RuleOp::LEVEL, 8, 1}};
+    program.clear();
+    program.version++;
+    TEST_ASSERT_TRUE(program.addRule(both, 1, SET_12, NONE));
+    TEST_ASSERT_TRUE(program.addRule(both, 1, TOGGLE_13, NONE));
+    engine.reset(program);
+    fired[1] = NONE;
+    TEST_ASSERT_EQUAL(1, engine.update(program, 8, 1, fired, 1));
+    TEST_ASSERT_EQUAL(RuleActionType::SET, fired[0].type);
+    TEST_ASSERT_EQUAL(RuleActionType::NONE, fired[1].type);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_add_rule_checks_stack_shape);
+    RUN_TEST(test_rose_fires_once_per_rising_edge);
+    RUN_TEST(test_fell_runs_else_when_edge_passes);
+    RUN_TEST(test_changed_fires_on_every_edge);
+    RUN_TEST(test_edges_need_a_known_previous_value);
+    RUN_TEST(test_thresholds_fire_on_crossing_only);
+    RUN_TEST(test_and_or_not);
+    RUN_TEST(test_edge_gated_by_level);
+    RUN_TEST(test_not_of_edge_does_not_refire);
+    RUN_TEST(test_only_rules_reading_the_pin_run);
+    return UNITY_END();
+}
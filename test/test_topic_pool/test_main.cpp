@@ -0,0 +1,218 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "TopicPool.h"
+#include "../AllocationCounter.h"
+
+static const uint8_t MAX_PINS = 40;
+
+// Hot per-pin fields as laid out in PinState, against the map entry they
+// replaced (a struct holding its report topic as a heap string)
+struct TablePin {
+    uint8_t mode;
+    bool retain;
+    uint16_t debounceMs;
+    uint16_t topic;
+    uint32_t reportIntervalMs;
+};
+
+struct MapPin {
+    uint8_t mode;
+    bool retain;
+    uint16_t debounceMs;
+    uint32_t reportIntervalMs;
+    std::string reportTopic;
+};
+
+typedef TopicPool<1024, MAX_PINS> Pool;
+typedef TopicPool<64, 8> SmallPool;
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom() {
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+void setUp(void) {
+    randomState = 1;
+    allocations = 0;
+    counting = false;
+}
+
+void tearDown(void) {}
+
+void test_intern_shares_equal_strings(void) {
+    static Pool pool;
+    uint16_t a = pool.intern("dev/io/4/state");
+    uint16_t b = pool.intern("dev/io/4/state");
+    uint16_t c = pool.intern("dev/io/5/state");
+    TEST_ASSERT_NOT_EQUAL(Pool::INVALID, a);
+    TEST_ASSERT_EQUAL(a, b);
+    TEST_ASSERT_NOT_EQUAL(a, c);
+    TEST_ASSERT_EQUAL(strlen("dev/io/4/state") + strlen("dev/io/5/state") + 2, pool.used());
+
+    // The copy lives until its last reference is released
+    pool.release(a);
+    TEST_ASSERT_EQUAL_STRING("dev/io/4/state", pool.get(b));
+    pool.release(b);
+    TEST_ASSERT_EQUAL_STRING("", pool.get(b));
+    TEST_ASSERT_EQUAL(0, pool.length(b));
+    TEST_ASSERT_EQUAL_STRING("dev/io/5/state", pool.get(c));
+    TEST_ASSERT_EQUAL_STRING("", pool.get(Pool::INVALID));
+}
+
+void test_compaction_keeps_handles(void) {
+    SmallPool pool;
+    uint16_t a = pool.intern("aaaaaaaaaaaaaaa");     // 16 bytes each
+    uint16_t b = pool.intern("bbbbbbbbbbbbbbb");
+    uint16_t c = pool.intern("ccccccccccccccc");
+    uint16_t d = pool.intern("ddddddddddddddd");
+    TEST_ASSERT_EQUAL(64, pool.used());
+    TEST_ASSERT_EQUAL(SmallPool::INVALID, pool.intern("e"));
+
+    // Freeing the second string makes room only once the arena is compacted
+    pool.release(b);
+    uint16_t e = pool.intern("eeeeeeeeeeeeeee");
+    TEST_ASSERT_NOT_EQUAL(SmallPool::INVALID, e);
+    TEST_ASSERT_EQUAL(64, pool.used());
+    TEST_ASSERT_EQUAL_STRING("aaaaaaaaaaaaaaa", pool.get(a));
+    TEST_ASSERT_EQUAL_STRING("ccccccccccccccc", pool.get(c));
+    TEST_ASSERT_EQUAL_STRING("ddddddddddddddd", pool.get(d));
+    TEST_ASSERT_EQUAL_STRING("eeeeeeeeeeeeeee", pool.get(e));
+}
+
+// Random configure/remove churn against a reference map: every live handle
+// must keep resolving to its own text across any number of compactions, and
+// the pool never touches the heap
+void test_churn_and_intern_rate(void) {
+    static Pool pool;
+    std::map<int, std::string> expected;
+    std::map<int, uint16_t> handles;
+    char text[64];
+    uint32_t interned = 0;
+    uint32_t mismatches = 0;
+    double internSeconds = 0;
+
+    for (int round = 0; round < 200000; round++) {
+        int key = (int)(nextRandom() % 48);
+        auto it = handles.find(key);
+        if (it != handles.end()) {
+            if (nextRandom() & 0x1) {
+                pool.release(it->second);
+                handles.erase(it);
+                expected.erase(key);
+            }
+            continue;
+        }
+
+        snprintf(text, sizeof(text), "esp32vault/ESP32-Vault-A1B2C3D4/io/%d/state%.*s",
+                 key % 24, (int)(nextRandom() % 8), "xxxxxxxx");
+
+        counting = true;
+        auto start = std::chrono::steady_clock::now();
+        uint16_t id = pool.intern(text);
+        internSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        counting = false;
+
+        if (id != Pool::INVALID) {
+            handles[key] = id;
+            expected[key] = text;
+            interned++;
+        }
+
+        for (auto& entry : handles) {
+            if (expected[entry.first] != pool.get(entry.second)) {
+                mismatches++;
+            }
+        }
+    }
+
+    char line[120];
+    snprintf(line, sizeof(line), "%u interns (with compaction) at %.0f ns each, arena %zu bytes in use",
+             interned, internSeconds * 1e9 / interned, pool.used());
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(0, mismatches);
+    TEST_ASSERT_EQUAL(0, allocations);
+    TEST_ASSERT_GREATER_THAN(1000, interned);
+}
+
+// Lookup and iteration cost of the GPIO-indexed table against the std::map
+// it replaced, for a typical set of configured pins
+void test_table_vs_map(void) {
+    static Pool pool;
+    static TablePin table[MAX_PINS];
+    uint64_t configuredMask = 0;
+    std::map<uint8_t, MapPin> pins;
+    const uint8_t used[] = {2, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33, 34};
+    char text[64];
+
+    for (uint8_t pin : used) {
+        snprintf(text, sizeof(text), "esp32vault/ESP32-Vault-A1B2C3D4/io/%u/state", pin);
+        table[pin] = {1, false, 50, pool.intern(text), 1000};
+        configuredMask |= 1ULL << pin;
+        pins[pin] = {1, false, 50, 1000, text};
+    }
+
+    const int LOOKUPS = 2000000;
+    volatile uint32_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        uint8_t pin = used[i % sizeof(used)];
+        if (configuredMask & (1ULL << pin)) {
+            sink = sink + table[pin].reportIntervalMs + (uint32_t)pool.length(table[pin].topic);
+        }
+    }
+    double tableLookupNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        auto it = pins.find(used[i % sizeof(used)]);
+        if (it != pins.end()) {
+            sink = sink + it->second.reportIntervalMs + (uint32_t)it->second.reportTopic.length();
+        }
+    }
+    double mapLookupNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+
+    const int SWEEPS = 200000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SWEEPS; i++) {
+        uint64_t pending = configuredMask;
+        while (pending != 0) {
+            uint8_t pin = __builtin_ctzll(pending);
+            pending &= pending - 1;
+            sink = sink + table[pin].debounceMs;
+        }
+    }
+    double tableSweepNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SWEEPS;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SWEEPS; i++) {
+        for (auto& entry : pins) {
+            sink = sink + entry.second.debounceMs;
+        }
+    }
+    double mapSweepNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SWEEPS;
+
+    char line[160];
+    snprintf(line, sizeof(line), "lookup: table %.2f ns, map %.2f ns; sweep of %zu pins: table %.1f ns, map %.1f ns",
+             tableLookupNs, mapLookupNs, sizeof(used), tableSweepNs, mapSweepNs);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_TRUE(tableLookupNs < mapLookupNs);
+    TEST_ASSERT_TRUE(tableSweepNs < mapSweepNs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_intern_shares_equal_strings);
+    RUN_TEST(test_compaction_keeps_handles);
+    RUN_TEST(test_churn_and_intern_rate);
+    RUN_TEST(test_table_vs_map);
+    return UNITY_END();
+}
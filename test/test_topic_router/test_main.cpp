@@ -0,0 +1,323 @@
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "PublishQueue.h"
+#include "TopicRouter.h"
+#include "../AllocationCounter.h"
+
+static const char* const BASE = "esp32vault/ESP32-Vault-A1B2C3D4";
+
+// The device's command topics, in the order the old if/else chain tested them
+static const char* const COMMANDS[] = {
+    "config/set", "cmd/mqtt", "cmd/ota_update", "cmd/restart", "cmd/reset_wifi",
+    "cmd/io/config", "cmd/io/exclude", "cmd/io/batch", "cmd/io/waveform",
+    "cmd/io/write", "cmd/io/snapshot", "cmd/io/rules", "cmd/io/history",
+};
+static const int COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+static const int TRIGGER_ROUTE = 100;
+
+static int routed = -1;
+static uint32_t routedPin = 0;
+
+static std::string deviceTopic(const char* suffix) {
+    return std::string(BASE) + "/" + suffix;
+}
+
+static void registerDeviceRoutes(TopicRouter& router) {
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        TEST_ASSERT_TRUE(router.on(deviceTopic(COMMANDS[i]).c_str(),
+                                   [i](const TopicMatch&, const char*, size_t) { routed = i; }));
+    }
+    TEST_ASSERT_TRUE(router.on(deviceTopic("cmd/io/{pin}/trigger").c_str(),
+                               [](const TopicMatch& match, const char*, size_t) {
+                                   routed = TRIGGER_ROUTE;
+                                   routedPin = match.number(0);
+                               }));
+}
+
+// Same test as String::endsWith("/" + suffix)
+static bool endsWith(const std::string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    return text.size() > length && text[text.size() - length - 1] == '/' &&
+           text.compare(text.size() - length, length, suffix) == 0;
+}
+
+// What the callback did before the router: copy topic and payload into heap
+// strings, then test each suffix in turn
+static int legacyDispatch(const char* topic, const char* payload, size_t length) {
+    std::string topicStr(topic);
+    std::string payloadStr;
+    for (size_t i = 0; i < length; i++) {
+        payloadStr += payload[i];
+    }
+
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        if (endsWith(topicStr, COMMANDS[i])) {
+            return i;
+        }
+    }
+    size_t io = topicStr.find("/cmd/io/");
+    if (io != std::string::npos && endsWith(topicStr, "trigger")) {
+        size_t start = io + 8;
+        std::string pin = topicStr.substr(start, topicStr.find("/trigger") - start);
+        routedPin = (uint32_t)atoi(pin.c_str());
+        return TRIGGER_ROUTE;
+    }
+    return -1;
+}
+
+void setUp(void) {
+    routed = -1;
+    routedPin = 0;
+    allocations = 0;
+    counting = false;
+}
+
+void tearDown(void) {}
+
+void test_literals_and_number_capture(void) {
+    static TopicRouter router;
+    registerDeviceRoutes(router);
+
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        routed = -1;
+        TEST_ASSERT_TRUE(router.dispatch(deviceTopic(COMMANDS[i]).c_str(), "", 0));
+        TEST_ASSERT_EQUAL(i, routed);
+    }
+
+    TEST_ASSERT_TRUE(router.dispatch(deviceTopic("cmd/io/13/trigger").c_str(), "set", 3));
+    TEST_ASSERT_EQUAL(TRIGGER_ROUTE, routed);
+    TEST_ASSERT_EQUAL(13, routedPin);
+
+    // Not a number, a missing level, a prefix and an extra level
+    TEST_ASSERT_FALSE(router.dispatch(deviceTopic("cmd/io/x1/trigger").c_str(), "", 0));
+    TEST_ASSERT_FALSE(router.dispatch(deviceTopic("cmd/io//trigger").c_str(), "", 0));
+    TEST_ASSERT_FALSE(router.dispatch(deviceTopic("cmd/io").c_str(), "", 0));
+    TEST_ASSERT_FALSE(router.dispatch(deviceTopic("cmd/restart/now").c_str(), "", 0));
+    TEST_ASSERT_FALSE(router.dispatch("other/device/cmd/restart", "", 0));
+}
+
+void test_wildcards(void) {
+    static TopicRouter router;
+    TopicMatch match;
+    TEST_ASSERT_TRUE(router.on("a/+/c", nullptr));
+    TEST_ASSERT_TRUE(router.on("a/b/#", nullptr));
+    TEST_ASSERT_TRUE(router.on("x/#", nullptr));
+
+    // A literal branch that dead-ends falls back to the wildcard
+    TEST_ASSERT_EQUAL(1, router.match("a/b/c", match));
+    TEST_ASSERT_EQUAL(1, match.count);
+    TEST_ASSERT_EQUAL(1, match.captureLength[0]);
+    TEST_ASSERT_EQUAL(0, router.match("a/x/c", match));
+    TEST_ASSERT_EQUAL(1, match.count);
+    TEST_ASSERT_EQUAL(0, strncmp("x", match.captureStart[0], match.captureLength[0]));
+    TEST_ASSERT_EQUAL(1, router.match("a/b/c/d", match));
+    TEST_ASSERT_EQUAL(3, match.captureLength[0]);
+    TEST_ASSERT_EQUAL(-1, router.match("a/x/d", match));
+
+    // A trailing '#' also matches the parent level, with an empty capture
+    TEST_ASSERT_EQUAL(2, router.match("x", match));
+    TEST_ASSERT_EQUAL(1, match.count);
+    TEST_ASSERT_EQUAL(0, match.captureLength[0]);
+    TEST_ASSERT_EQUAL(1, router.match("a/b", match));
+    TEST_ASSERT_EQUAL(2, router.match("x/", match));
+    TEST_ASSERT_EQUAL(-1, router.match("xy", match));
+}
+
+void test_exact_route_beats_parent_wildcard(void) {
+    static TopicRouter router;
+    TopicMatch match;
+    TEST_ASSERT_TRUE(router.on("a/#", nullptr));
+    TEST_ASSERT_TRUE(router.on("a", nullptr));
+    TEST_ASSERT_EQUAL(1, router.match("a", match));
+    TEST_ASSERT_EQUAL(0, match.count);
+    TEST_ASSERT_EQUAL(0, router.match("a/b", match));
+}
+
+void test_malformed_patterns(void) {
+    static TopicRouter router;
+    TEST_ASSERT_TRUE(router.on("a/+/c", nullptr));
+    TEST_ASSERT_FALSE(router.on("a/+/c", nullptr));         // Already registered
+    TEST_ASSERT_FALSE(router.on("a/#/c", nullptr));         // '#' not last
+    TEST_ASSERT_FALSE(router.on("a/b{/c", nullptr));
+    TEST_ASSERT_FALSE(router.on("a/b+/c", nullptr));
+    TEST_ASSERT_FALSE(router.on("+/+/+/+/+", nullptr));     // Too many captures
+    TEST_ASSERT_FALSE(router.on("", nullptr));
+    TEST_ASSERT_FALSE(router.on(nullptr, nullptr));
+}
+
+// Dispatch cost of the router against the chain it replaced, over every
+// device command. The router must also dispatch without touching the heap.
+void test_router_vs_legacy_chain(void) {
+    static TopicRouter router;
+    registerDeviceRoutes(router);
+
+    std::string topics[COMMAND_COUNT + 1];
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        topics[i] = deviceTopic(COMMANDS[i]);
+    }
+    topics[COMMAND_COUNT] = deviceTopic("cmd/io/25/trigger");
+    const char payload[] = "{\"pin\":25,\"mode\":\"output\"}";
+    const size_t payloadLength = sizeof(payload) - 1;
+
+    const int MESSAGES = 1000000;
+    long checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MESSAGES; i++) {
+        checksum += legacyDispatch(topics[i % (COMMAND_COUNT + 1)].c_str(), payload, payloadLength);
+    }
+    double legacyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / MESSAGES;
+
+    long routedSum = 0;
+    counting = true;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MESSAGES; i++) {
+        router.dispatch(topics[i % (COMMAND_COUNT + 1)].c_str(), payload, payloadLength);
+        routedSum += routed;
+    }
+    double routerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / MESSAGES;
+    counting = false;
+
+    char line[160];
+    snprintf(line, sizeof(line), "dispatch of %d command topics: strcmp chain %.1f ns, router %.1f ns, router allocations %zu",
+             COMMAND_COUNT + 1, legacyNs, routerNs, allocations);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(checksum, routedSum);
+    TEST_ASSERT_EQUAL(0, allocations);
+    TEST_ASSERT_TRUE(routerNs < legacyNs);
+}
+
+// The device's inbound path end to end, before and after the router. The
+// old callback appended the message into two Strings and passed them by
+// value to a std::function<void(String, String)> handler, which parsed the
+// pin out of the topic. Now the message is copied out of the client's
+// receive buffer (copyInboundMessage, as MQTTManager::callback does),
+// routed, decoded into a StaticJsonDocument and answered through the
+// outbound queue. The reply is built in the receive buffer, as the client
+// does when it writes a packet, and the handler must still see its own
+// payload and capture afterwards. Nothing on the new path may touch the
+// heap. String is modelled with std::string.
+void test_inbound_path(void) {
+    static TopicRouter router;
+    static PublishQueue<16, 1024> outbound;
+    static char receiveBuffer[1024];
+    static char inboundBuffer[1024];
+    static const char command[] = "{\"action\":\"pulse\",\"pulse\":250}";
+    const size_t commandLength = sizeof(command) - 1;
+    const std::string statusTopic = deviceTopic("status");
+    uint32_t handled = 0;
+    uint32_t intact = 0;
+
+    // Both handlers do the same work: decode, reply, check what they were given
+    auto handle = [&](uint32_t pin, const char* payload, size_t length, const char* topic, const char* capture) {
+        StaticJsonDocument<128> doc;
+        if (deserializeJson(doc, payload, length)) {
+            return;
+        }
+        uint16_t pulse = doc["pulse"] | 100;
+
+        // A publish from the owner task reuses the client's buffer
+        memset(receiveBuffer, 'x', sizeof(receiveBuffer));
+        const char status[] = "io_trigger_success";
+        outbound.push(topic, reinterpret_cast<const uint8_t*>(status), sizeof(status) - 1, false);
+
+        if (pin == 25 && pulse == 250 && length == commandLength && memcmp(payload, command, length) == 0 &&
+            strncmp(capture, "25", 2) == 0) {
+            intact++;
+        }
+        handled++;
+    };
+
+    std::function<void(std::string, std::string)> legacyCallback = [&](std::string topic, std::string payload) {
+        size_t io = topic.find("/cmd/io/");
+        if (io == std::string::npos || !endsWith(topic, "trigger")) {
+            return;
+        }
+        size_t start = io + 8;
+        std::string pin = topic.substr(start, topic.find("/trigger") - start);
+        std::string replyTopic = topic.substr(0, io) + "/status";
+        handle((uint32_t)atoi(pin.c_str()), payload.c_str(), payload.length(), replyTopic.c_str(), pin.c_str());
+    };
+
+    TEST_ASSERT_TRUE(router.on(deviceTopic("cmd/io/{pin}/trigger").c_str(),
+                               [&](const TopicMatch& match, const char* payload, size_t length) {
+        handle(match.number(0), payload, length, statusTopic.c_str(), match.captureStart[0]);
+    }));
+
+    const std::string topic = deviceTopic("cmd/io/25/trigger");
+    PublishQueue<16, 1024>::Message message;
+    const int MESSAGES = 100000;
+
+    // What the client hands the callback
+    auto receive = [&]() {
+        memcpy(receiveBuffer, topic.c_str(), topic.size() + 1);
+        memcpy(receiveBuffer + topic.size() + 1, command, commandLength);
+    };
+    auto drain = [&]() {
+        while (outbound.front(message)) {
+            outbound.pop();
+        }
+    };
+
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MESSAGES; i++) {
+        receive();
+        const char* payload = receiveBuffer + topic.size() + 1;
+        std::string topicStr = std::string(receiveBuffer);
+        std::string payloadStr = "";
+        for (size_t j = 0; j < commandLength; j++) {
+            payloadStr += payload[j];
+        }
+        legacyCallback(topicStr, payloadStr);
+        drain();
+    }
+    double legacyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / MESSAGES;
+    size_t legacyAllocations = allocations;
+
+    TEST_ASSERT_EQUAL(MESSAGES, handled);
+    TEST_ASSERT_EQUAL(MESSAGES, intact);
+    handled = 0;
+    intact = 0;
+    allocations = 0;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < MESSAGES; i++) {
+        receive();
+        const uint8_t* payload = reinterpret_cast<const uint8_t*>(receiveBuffer + topic.size() + 1);
+        char* payloadCopy = copyInboundMessage(inboundBuffer, sizeof(inboundBuffer), receiveBuffer, payload, commandLength);
+        router.dispatch(inboundBuffer, payloadCopy, commandLength);
+        drain();
+    }
+    double routerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / MESSAGES;
+    counting = false;
+
+    char line[160];
+    snprintf(line, sizeof(line), "inbound trigger command: String callback %.1f ns, %.1f allocations; router %.1f ns, %.1f allocations",
+             legacyNs, (double)legacyAllocations / MESSAGES, routerNs, (double)allocations / MESSAGES);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_EQUAL(MESSAGES, handled);
+    TEST_ASSERT_EQUAL(MESSAGES, intact);
+    TEST_ASSERT_TRUE(legacyAllocations > 0);
+    TEST_ASSERT_EQUAL(0, allocations);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_literals_and_number_capture);
+    RUN_TEST(test_wildcards);
+    RUN_TEST(test_exact_route_beats_parent_wildcard);
+    RUN_TEST(test_malformed_patterns);
+    RUN_TEST(test_router_vs_legacy_chain);
+    RUN_TEST(test_inbound_path);
+    return UNITY_END();
+}